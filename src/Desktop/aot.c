@@ -0,0 +1,160 @@
+//Ahead of time recompiler. Walks every instruction reachable from 0x200 in a ROM and writes a C++ file with
+//one function per basic block, each a straight run of calls into ops.h with the instruction baked in as a
+//constant so the compiler can fold it away. Build the result with -DCHIP8_AOT and pick dispatch = 4.
+//
+//Usage: aot <rom.ch8> <out.cpp> [emulator_type]
+
+#include "chip8.h"
+
+#define AOT_MAX_BLOCK 64 //Same cap as the JIT, blocks exit early when the batch runs out so this only bounds code size
+
+static const char *const emu_names[] = {[COSMAC] = "COSMAC", [AMIGA] = "AMIGA", [SCHIP] = "SCHIP", [XOCHIP] = "XOCHIP"};
+
+//Control flow recovered from the ROM
+typedef struct{
+    bool start[4096];   //A block starts at this address
+    bool used[4096];    //Some block runs the instruction at this address
+    bool queued[4096];
+    uint16_t work[4096];
+    int pending;
+} cfg_type;
+
+static void add_target(cfg_type *cfg, uint16_t addr){
+    if(addr > 0xFFE || cfg->queued[addr]){return;} //Off the end of ram, emulate() deals with it if it ever happens
+    cfg->queued[addr] = true;
+    cfg->work[cfg->pending++] = addr;
+}
+
+//Anything that changes pc, waits, or writes ram ends a block, the generated code sets pc and calls its handler last
+static bool ends_block(uint8_t op){
+    switch(op){
+        case(OP_1NNN): case(OP_2NNN): case(OP_00EE): case(OP_BNNN): case(OP_BXNN):
+        case(OP_3XNN): case(OP_4XNN): case(OP_5XY0): case(OP_9XY0): case(OP_EX9E): case(OP_EXA1):
+        case(OP_FX0A): case(OP_FX33): case(OP_FX55): case(OP_FX55_I): case(OP_00FD):{return true;}
+        default:{return false;}
+    }
+}
+
+//Timers are worked out from chip8->cycles, which run_aot() only brings up to date between blocks,
+//so an op that reads or sets one always starts a block
+static bool uses_timers(uint8_t op){
+    return op == OP_FX07 || op == OP_FX15 || op == OP_FX18;
+}
+
+//Walk the block at start, returns how many instructions it has and leaves *last on the final one
+static int walk(const chip8_type *chip8, uint16_t start, uint16_t *last){
+    uint16_t addr = start;
+    for(int len = 1; ; len++, addr += 2){
+        *last = addr;
+        if(ends_block(chip8->cache[addr].base_op) || len == AOT_MAX_BLOCK || addr + 2 > 0xFFE){return len;}
+        if(uses_timers(chip8->cache[addr + 2].base_op)){return len;}
+    }
+}
+
+static void find_blocks(const chip8_type *chip8, cfg_type *cfg){
+    add_target(cfg, 0x200);
+
+    while(cfg->pending){
+        const uint16_t start = cfg->work[--cfg->pending];
+        uint16_t last;
+        walk(chip8, start, &last);
+        cfg->start[start] = true;
+        for(uint16_t addr = start; addr <= last; addr += 2){cfg->used[addr] = true;}
+
+        const instr_type *inst = &chip8->cache[last];
+        switch(inst->base_op){
+            case(OP_1NNN):{add_target(cfg, inst->NNN); break;}
+            case(OP_2NNN):{add_target(cfg, inst->NNN); add_target(cfg, last + 2); break;} //Return lands after the call
+            case(OP_3XNN): case(OP_4XNN): case(OP_5XY0): case(OP_9XY0): case(OP_EX9E): case(OP_EXA1):{
+                add_target(cfg, last + 2);
+                add_target(cfg, last + 4);
+                break;
+            }
+            case(OP_00EE): case(OP_BNNN): case(OP_BXNN):{break;} //Returns come from 2NNN, computed jumps are left to emulate()
+            case(OP_00FD):{break;} //Never leaves
+            default:{add_target(cfg, last + 2); break;} //FX0A/FX33/FX55, a timer op next or the block hit its cap
+        }
+    }
+}
+
+static void write_inst(FILE *out, const instr_type *inst, uint16_t addr){
+    //Blocks call each handler on its own, so op never needs to be a fused pair here
+    fprintf(out, "static const instr_type inst_%03X = {{0x%04X}, 0x%03X, 0x%02X, 0x%X, 0x%X, 0x%X, %s, %s};\n",
+        addr, inst->opcode.full_op, inst->NNN, inst->NN, inst->N, inst->X, inst->Y, op_names[inst->base_op], op_names[inst->base_op]);
+}
+
+static void write_call(FILE *out, const instr_type *inst, uint16_t addr){
+    if(inst->base_op == OP_NOP){return;}
+    fprintf(out, "    op_%s(chip8, &inst_%03X);\n", op_names[inst->base_op] + 3, addr);
+}
+
+static void write_block(FILE *out, const chip8_type *chip8, uint16_t start){
+    uint16_t last;
+    walk(chip8, start, &last);
+
+    //Same budget check as the JIT before every instruction but the first, the batch can end anywhere in a block
+    //and only the last instruction moves pc, so leaving with pc on the next one is all a side exit has to do
+    fprintf(out, "static int block_%03X(chip8_type *chip8, int%s){\n", start, (last != start) ? " count" : ""); //One instruction blocks have no check
+    for(uint16_t addr = start; addr < last; addr += 2){
+        if(addr != start){fprintf(out, "    if(count <= %d){chip8->pc = 0x%03X; return %d;}\n", (addr - start) / 2, addr, (addr - start) / 2);}
+        write_call(out, &chip8->cache[addr], addr);
+    }
+    if(last != start){fprintf(out, "    if(count <= %d){chip8->pc = 0x%03X; return %d;}\n", (last - start) / 2, last, (last - start) / 2);}
+    fprintf(out, "    chip8->pc = 0x%03X;\n", last + 2); //Only the last instruction can look at pc, it sees it the way emulate() would leave it
+    write_call(out, &chip8->cache[last], last);
+    fprintf(out, "    return %d;\n}\n\n", (last - start) / 2 + 1);
+}
+
+int main(int argc, char *argv[]){
+    if(argc < 3){fprintf(stderr, "Usage: %s <rom.ch8> <out.cpp> [emulator_type]\n", argv[0]); return EXIT_FAILURE;}
+
+    static config_type config;
+    static chip8_type chip8;
+    static cfg_type cfg;
+
+    snprintf(config.rom_name, sizeof config.rom_name, "%s", argv[1]);
+    config.choice = (argc > 3) ? (emu_type)atoi(argv[3]) : COSMAC;
+    if(config.choice > XOCHIP){fprintf(stderr, "Unknown emulator_type %d, using COSMAC\n", config.choice); config.choice = COSMAC;}
+    if(!init_chip8(&chip8, &config)){return EXIT_FAILURE;}
+
+    FILE *rom = fopen(config.rom_name, "rb");
+    fseek(rom, 0, SEEK_END);
+    const long rom_size = ftell(rom);
+    fclose(rom);
+    if(rom_size == 0){fprintf(stderr, "ROM file %s is empty\n", config.rom_name); return EXIT_FAILURE;}
+
+    find_blocks(&chip8, &cfg);
+
+    FILE *out = fopen(argv[2], "w");
+    if(!out){fprintf(stderr, "Could not open %s for writing\n", argv[2]); return EXIT_FAILURE;}
+
+    fprintf(out, "//Generated by aot from %s for %s, do not edit\n\n", config.rom_name, emu_names[config.choice]);
+    fprintf(out, "#include \"aot.h\"\n#include \"ops.h\"\n\n");
+
+    for(uint16_t addr = 0; addr < 4096; addr++){if(cfg.used[addr]){write_inst(out, &chip8.cache[addr], addr);}}
+    fprintf(out, "\n");
+
+    int count = 0;
+    for(uint16_t addr = 0; addr < 4096; addr++){if(cfg.start[addr]){write_block(out, &chip8, addr); count++;}}
+
+    fprintf(out, "const aot_block aot_blocks[] = {\n");
+    for(uint16_t addr = 0; addr < 4096; addr++){
+        if(!cfg.start[addr]){continue;}
+        uint16_t last;
+        const int len = walk(&chip8, addr, &last);
+        fprintf(out, "    {0x%03X, 0x%03X, %d, block_%03X},\n", addr, last + 2, len, addr);
+    }
+    fprintf(out, "};\nconst uint16_t aot_block_count = %d;\n\n", count);
+
+    fprintf(out, "int aot_find(uint16_t pc){\n    switch(pc){\n");
+    for(uint16_t addr = 0, i = 0; addr < 4096; addr++){if(cfg.start[addr]){fprintf(out, "        case 0x%03X: return %d;\n", addr, i++);}}
+    fprintf(out, "        default: return -1;\n    }\n}\n\n");
+
+    fprintf(out, "const uint8_t aot_rom[] = {");
+    for(long i = 0; i < rom_size; i++){fprintf(out, "%s0x%02X,", (i % 16) ? " " : "\n    ", chip8.ram[0x200 + i]);}
+    fprintf(out, "\n};\nconst uint16_t aot_rom_size = %ld;\nconst emu_type aot_choice = %s;\n", rom_size, emu_names[config.choice]);
+
+    fclose(out);
+    printf("%s: %d blocks\n", argv[2], count);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,37 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include "chip8.h"
+
+//Interface between the engine and the C++ file the aot tool generates for one ROM.
+//Only builds with -DCHIP8_AOT link a generated file in, see the native target in the makefile.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct{
+    uint16_t start; //First ram byte the block was generated from, also the pc it runs at
+    uint16_t end;   //One past its last byte
+    uint8_t len;    //Instructions it runs given the budget for all of them
+    int (*run)(chip8_type *chip8, int count); //Runs at most count instructions and returns how many, pc is left on the next one
+} aot_block;
+
+//Defined by the generated file
+extern const aot_block aot_blocks[];
+extern const uint16_t aot_block_count;
+extern const uint8_t aot_rom[];
+extern const uint16_t aot_rom_size;
+extern const emu_type aot_choice;
+int aot_find(uint16_t pc); //Index into aot_blocks of the block starting at pc, -1 if there isn't one
+
+//Defined in aot_run.c
+bool aot_matches(const chip8_type *chip8, const config_type *config);
+void aot_invalidate(chip8_type *chip8, uint16_t addr, uint16_t len);
+void run_aot(chip8_type *chip8, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
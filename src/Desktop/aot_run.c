@@ -0,0 +1,25 @@
+#include "aot.h"
+
+//Generated code is only right for the ROM and interpreter it was generated from
+bool aot_matches(const chip8_type *chip8, const config_type *config){
+    return config->choice == aot_choice && !memcmp(&chip8->ram[0x200], aot_rom, aot_rom_size);
+}
+
+//addr to addr+len-1 was written, stop using every block generated from those bytes
+void aot_invalidate(chip8_type *chip8, uint16_t addr, uint16_t len){
+    const uint16_t last = addr + len;
+    for(uint16_t i = 0; i < aot_block_count; i++){
+        if(aot_blocks[i].start < last && addr < aot_blocks[i].end){chip8->aot_stale[i] = true;}
+    }
+}
+
+void run_aot(chip8_type *chip8, int count){
+    while(count > 0){
+        if(chip8->cache[chip8->pc & 0x0FFF].op >= OP_IDLE_1NNN){count -= emulate(chip8, count); continue;} //Idle loop, skip to the end of the batch
+        const int i = aot_find(chip8->pc);
+        //Blocks check the budget themselves like the JIT's do, so a block longer than the batch still runs natively
+        if(i >= 0 && !chip8->aot_stale[i]){const int ran = aot_blocks[i].run(chip8, count); chip8->cycles += ran; count -= ran; continue;}
+        emulate(chip8, 1); //Computed jumps into unknown code and stale blocks
+        count--;
+    }
+}
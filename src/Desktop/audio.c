@@ -0,0 +1,84 @@
+#include <string.h>
+#include <math.h>
+#include "audio.h"
+
+#define AUDIO_FRESH 0x4 //Set on middle when it holds a sound the callback hasn't picked up
+#define AUDIO_SLOT  0x3
+
+void audio_init(audio_type *audio, int rate, int volume){
+    if(volume < 0){volume = 0;}
+    if(volume > 100){volume = 100;}
+    audio->rate = rate;
+    audio->amplitude = (int16_t)(volume * INT16_MAX / 100);
+    audio->phase = 0;
+    atomic_init(&audio->active, false);
+
+    audio->back = 0;
+    atomic_init(&audio->middle, 1);
+    audio->front = 2;
+
+    //pow() is far too slow for the callback, and there are only 256 pitches
+    for(int pitch = 0; pitch < 256; pitch++){
+        const double samples_per_sec = 4000.0 * pow(2.0, (pitch - 64) / 48.0);
+        audio->steps[pitch] = (uint32_t)(samples_per_sec * (1u << AUDIO_PHASE_BITS) / rate + 0.5);
+    }
+}
+
+//Buffer size to ask SDL for, a power of two (which SDL wants) no longer than AUDIO_MAX_LATENCY_MS
+int audio_samples(int samples, int rate){
+    const int most = rate * AUDIO_MAX_LATENCY_MS / 1000;
+    int size = 64; //Much smaller and the callback runs so often it starts to underrun
+    while(size * 2 <= samples && size * 2 <= most){size *= 2;}
+    return size;
+}
+
+//Called once a frame from the emulation thread. Relaxed is enough for the flag as nothing is published
+//with it, the pattern and pitch only go through the triple buffer when one of them changed
+void audio_post(audio_type *audio, bool active, const uint8_t pattern[16], uint8_t pitch){
+    atomic_store_explicit(&audio->active, active, memory_order_relaxed);
+    if(audio->posted.pitch == pitch && !memcmp(audio->posted.pattern, pattern, sizeof audio->posted.pattern)){return;}
+
+    memcpy(audio->posted.pattern, pattern, sizeof audio->posted.pattern);
+    audio->posted.pitch = pitch;
+    audio->slots[audio->back] = audio->posted;
+    audio->back = atomic_exchange_explicit(&audio->middle, audio->back | AUDIO_FRESH, memory_order_acq_rel) & AUDIO_SLOT;
+}
+
+//Set samples from the start of the pattern up to pos, in 2^AUDIO_PHASE_BITS ths of a sample
+static uint64_t area(const audio_type *audio, const sound_type *sound, uint32_t pos){
+    const uint32_t i = pos >> AUDIO_PHASE_BITS;
+    const uint32_t bit = (sound->pattern[i >> 3] >> (7 - (i & 7))) & 1;
+    return ((uint64_t)audio->ones[i] << AUDIO_PHASE_BITS) + (bit ? pos & ((1u << AUDIO_PHASE_BITS) - 1) : 0);
+}
+
+//SDL audio callback, fills a mono signed 16 bit buffer
+void audio_callback(void *data, uint8_t *stream, int len){
+    audio_type *audio = data;
+    int16_t *samples = (int16_t *)stream;
+    const int count = len / (int)sizeof(int16_t);
+
+    //Newest sound, picked up once per buffer
+    if(atomic_load_explicit(&audio->middle, memory_order_acquire) & AUDIO_FRESH){
+        audio->front = atomic_exchange_explicit(&audio->middle, audio->front, memory_order_acq_rel) & AUDIO_SLOT;
+        const uint8_t *pattern = audio->slots[audio->front].pattern;
+        for(int i = 0; i < 128; i++){audio->ones[i + 1] = audio->ones[i] + ((pattern[i >> 3] >> (7 - (i & 7))) & 1);}
+    }
+
+    if(!atomic_load_explicit(&audio->active, memory_order_relaxed)){memset(stream, 0, len); return;}
+
+    //Each output sample is the average of the pattern over the stretch of it that sample covers, a box
+    //filter, so pitches above the device rate come out as a level rather than aliasing
+    const sound_type *sound = &audio->slots[audio->front];
+    const uint32_t step = audio->steps[sound->pitch];
+    const uint64_t whole = (uint64_t)audio->ones[128] << AUDIO_PHASE_BITS;
+    const int64_t amplitude = audio->amplitude;
+    uint32_t phase = audio->phase;
+    for(int i = 0; i < count; i++){
+        const uint32_t next = phase + step;
+        const uint64_t set = (next > phase) ? area(audio, sound, next) - area(audio, sound, phase)
+                                            : whole - area(audio, sound, phase) + area(audio, sound, next); //Wrapped round to the start
+        samples[i] = (int16_t)(amplitude * (2 * (int64_t)set - step) / step);
+        phase = next;
+    }
+    audio->phase = phase;
+}
@@ -0,0 +1,49 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+//Sound timer output. Everything plays as an XO-CHIP pattern, 128 one bit samples looped at a rate set by
+//the pitch register, and ROMs that never load one get a square wave pattern. The emulation thread posts
+//whether the timer is running with an atomic store, and the pattern and pitch through a triple buffer
+//whenever they change. The audio callback picks up the newest once per buffer and resamples the pattern
+//to the device rate itself, so nothing on the emulation side runs per sample. The callback never
+//allocates, locks or waits, and its phase carries across buffers and pattern changes so the wave never jumps.
+
+#define AUDIO_RATE 44100
+#define AUDIO_MAX_LATENCY_MS 10 //Buffers longer than this are cut down to fit
+#define AUDIO_PHASE_BITS 25     //Fraction bits of a pattern position, 7 bits of whole samples on top fill the 32 bit phase
+
+typedef struct{
+    uint8_t pattern[16]; //Bit 7 of byte 0 plays first
+    uint8_t pitch;       //Pattern plays at 4000*2^((pitch-64)/48) samples a second
+} sound_type;
+
+typedef struct{
+    atomic_bool active; //Sound timer is running, set by the emulation thread
+
+    //Triple buffer of sounds, same scheme as frames_type
+    sound_type slots[3];
+    atomic_uint_fast8_t middle; //Slot waiting to be picked up, AUDIO_FRESH is set until the callback takes it
+    uint8_t back;               //Slot the emulation thread fills, only it touches this
+    uint8_t front;              //Slot the callback plays, only it touches this
+    sound_type posted;          //Last sound posted, so a frame that changed nothing posts nothing
+
+    //Set up before the device starts, read only after that
+    int rate;                //Samples per second the device was opened at
+    int16_t amplitude;       //Peak from the volume in the config
+    uint32_t steps[256];     //Phase step per device sample for each pitch
+
+    //Only the callback touches these
+    uint32_t phase;          //Position in the pattern, a whole pattern is 2^32 so it wraps by itself
+    uint32_t ones[129];      //Set samples in the playing pattern before each position, for the resampler
+} audio_type;
+
+void audio_init(audio_type *audio, int rate, int volume);
+int audio_samples(int samples, int rate);
+void audio_post(audio_type *audio, bool active, const uint8_t pattern[16], uint8_t pitch);
+void audio_callback(void *data, uint8_t *stream, int len);
+
+#endif
@@ -0,0 +1,218 @@
+//Benchmark suite. Links the core and nothing else (no SDL), runs every workload on every engine for a fixed
+//instruction count a few times over and reports ns per instruction with its spread.
+//  Micro: one opcode class repeated in a straight line with a jump back, so nearly every instruction is that class
+//  Macro: small whole programs built in here that behave like games do, plus any ROM files given
+//
+//Engines get one frame's worth of instructions per call, the same as the front end, so --ips sets the batch
+//size. The default is well above what games are played at so the numbers are about the engine, not the
+//per batch overhead (a JIT block leaves early wherever the batch runs out).
+//
+//Usage: bench [--insts N] [--reps N] [--ips N] [--json out.json] [rom.ch8 ...]
+
+#include "chip8.h"
+#include "jit.h"
+#include "state.h"
+#include <math.h>
+
+#define BODY_REPEATS 16   //Copies of a micro body before the jump back
+#define SUB_ADDR 0xE00    //Micro subroutines go here, well clear of the body
+#define MAX_WORKLOADS 64
+
+typedef struct{
+    const char *name;
+    emu_type choice;
+    uint16_t setup[8];  //Runs once, zero terminated
+    uint16_t body[8];   //Repeated BODY_REPEATS times then jumped back to, zero terminated
+    uint16_t sub[4];    //Placed at SUB_ADDR for 2NNN to call
+} micro_type;
+
+static const micro_type micros[] = {
+    {"6XNN/7XNN", COSMAC, {0}, {0x6012, 0x7103, 0x6234, 0x7305}, {0}},
+    {"8XYN", COSMAC, {0x6001, 0x6102, 0x6203}, {0x8014, 0x8125, 0x8236, 0x8017, 0x810E, 0x8231}, {0}},
+    {"skips", COSMAC, {0x6001, 0x6102}, {0x3000, 0x4001, 0x5010, 0x9000}, {0}}, //None taken
+    {"2NNN/00EE", COSMAC, {0}, {0x2E00}, {0x00EE}},
+    {"ANNN", COSMAC, {0}, {0xA300, 0xA310}, {0}},
+    {"CXNN", COSMAC, {0}, {0xC0FF, 0xC13F}, {0}},
+    {"DXYN", COSMAC, {0x6008, 0x6104, 0x6221, 0x6310, 0xA000}, {0xD015, 0xD235, 0xD01F, 0xD23A}, {0}},
+    {"EX9E", COSMAC, {0}, {0xE09E, 0xE19E}, {0}}, //No keys down, never skips
+    {"FX1E/FX29", COSMAC, {0x6001}, {0xF01E, 0xF129}, {0}},
+    {"FX33", COSMAC, {0x6A7B, 0xA800}, {0xFA33}, {0}},
+    {"FX55/FX65", SCHIP, {0xA800}, {0xF755, 0xF765}, {0}}, //SCHIP leaves I alone, so it stays on the same 8 bytes
+    {"timers", COSMAC, {0}, {0xF015, 0xF107, 0xF218}, {0}},
+};
+
+typedef struct{
+    const char *name;
+    uint16_t words[24]; //From 0x200, zero terminated
+} macro_type;
+
+static const macro_type macros[] = {
+    //Random sprites all over the screen
+    {"sprites", {0xA000, 0xC03F, 0xC11F, 0xD015, 0x7201, 0x1202}},
+    //Draw then wait out the delay timer, the way most games hold 60Hz
+    {"vsync", {0xA000, 0x6000, 0x6100, 0xD015, 0x7001, 0x6201, 0xF215, 0xF307, 0x3300, 0x120E, 0x1206}},
+    //Score display: BCD, read the digits back and draw each from the font
+    {"score", {0x6500, 0x7501, 0xA800, 0xF533, 0xF265, 0x6300, 0x6400, 0xF029, 0xD345, 0x7305,
+               0xF129, 0xD345, 0x7305, 0xF229, 0xD345, 0x00E0, 0x1202}},
+    //Subroutine heavy arithmetic
+    {"calls", {0x6001, 0x6103, 0x220A, 0x2210, 0x1204, 0x8014, 0x8115, 0x00EE, 0x8106, 0x810E, 0x8012, 0x00EE}},
+    //Rewrites an instruction ahead of itself every trip, the worst case for the decode cache and the JIT
+    {"smc", {0x6062, 0x6100, 0x7101, 0xA20C, 0xF155, 0x8324, 0x6200, 0x1204}},
+};
+
+static const char *const engine_names[] = {[SWITCH] = "switch", [TABLE] = "table", [THREADED] = "threaded", [JIT] = "jit"};
+
+typedef struct{
+    char name[64];
+    const char *kind;
+    emu_type choice;
+    uint8_t program[4096 - 0x200];
+    size_t size;
+} workload_type;
+
+typedef struct{
+    double mean, stddev, min; //ns per instruction over the timed reps
+} result_type;
+
+static size_t put(uint8_t *program, size_t at, uint16_t word){
+    program[at] = word >> 8;
+    program[at + 1] = word & 0xFF;
+    return at + 2;
+}
+
+static void build_micro(workload_type *work, const micro_type *micro){
+    snprintf(work->name, sizeof work->name, "%s", micro->name);
+    work->kind = "micro";
+    work->choice = micro->choice;
+    memset(work->program, 0, sizeof work->program);
+
+    size_t at = 0;
+    for(int i = 0; i < 8 && micro->setup[i]; i++){at = put(work->program, at, micro->setup[i]);}
+    const size_t body = at;
+    for(int r = 0; r < BODY_REPEATS; r++){
+        for(int i = 0; i < 8 && micro->body[i]; i++){at = put(work->program, at, micro->body[i]);}
+    }
+    at = put(work->program, at, 0x1000 | (0x200 + body));
+
+    size_t end = at;
+    for(int i = 0; i < 4 && micro->sub[i]; i++){end = put(work->program, SUB_ADDR - 0x200 + 2 * i, micro->sub[i]);}
+    work->size = end > at ? end : at;
+}
+
+static void build_macro(workload_type *work, const macro_type *macro){
+    snprintf(work->name, sizeof work->name, "%s", macro->name);
+    work->kind = "macro";
+    work->choice = COSMAC;
+    size_t at = 0;
+    for(int i = 0; i < 24 && macro->words[i]; i++){at = put(work->program, at, macro->words[i]);}
+    work->size = at;
+}
+
+static bool load_rom(workload_type *work, const char *path){
+    FILE *rom = fopen(path, "rb");
+    if(!rom){fprintf(stderr, "ROM file %s is invalid or does not exist\n", path); return false;}
+    work->size = fread(work->program, 1, sizeof work->program, rom);
+    fclose(rom);
+    snprintf(work->name, sizeof work->name, "%s", path);
+    work->kind = "rom";
+    work->choice = COSMAC;
+    return work->size > 0;
+}
+
+static double now_ns(void){
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+//Write s as a JSON string, ROM paths can hold quotes and backslashes
+static void json_string(FILE *json, const char *s){
+    fputc('"', json);
+    for(; *s; s++){
+        if(*s == '"' || *s == '\\'){fprintf(json, "\\%c", *s);}
+        else if((unsigned char)*s < 0x20){fprintf(json, "\\u%04x", (unsigned char)*s);}
+        else{fputc(*s, json);}
+    }
+    fputc('"', json);
+}
+
+//One untimed rep to warm the caches (and let the JIT compile), then reps timed ones. Every rep starts
+//from the state init left, so each one runs the same instructions
+static result_type measure(const workload_type *work, dispatch_type dispatch, int insts, int reps, int ips){
+    static chip8_type chip8; //Too big for the stack
+    static state_type start;
+    static config_type config;
+    config.choice = work->choice;
+    config.insts_per_sec = ips;
+    config.dispatch = dispatch;
+    config.seed = 1;
+    snprintf(config.rom_name, sizeof config.rom_name, "%s", work->name);
+
+    result_type result = {0, 0, INFINITY};
+    if(!init_chip8_program(&chip8, &config, work->program, work->size)){return result;}
+    const engine_type engine = select_engine(&chip8, &config);
+    save_state(&chip8, &start);
+
+    const int frame = ips / 60 > 0 ? ips / 60 : 1;
+    double sum = 0, sum_sq = 0;
+    for(int rep = -1; rep < reps; rep++){
+        //Only ram the last rep rewrote is invalidated, so compiled blocks for the rest carry over
+        if(!load_state(&chip8, &start)){jit_destroy(chip8.jit); return result;}
+        const double began = now_ns();
+        for(int left = insts; left > 0; left -= frame){engine(&chip8, left < frame ? left : frame);}
+        const double ns = (now_ns() - began) / insts;
+        if(rep < 0){continue;}
+        sum += ns;
+        sum_sq += ns * ns;
+        if(ns < result.min){result.min = ns;}
+    }
+    result.mean = sum / reps;
+    result.stddev = sqrt(fmax(sum_sq / reps - result.mean * result.mean, 0));
+
+    jit_destroy(chip8.jit);
+    return result;
+}
+
+int main(int argc, char *argv[]){
+    int insts = 2000000;
+    int reps = 10;
+    int ips = 60000;
+    const char *json_path = "bench.json";
+
+    static workload_type works[MAX_WORKLOADS];
+    int count = 0;
+    for(size_t i = 0; i < sizeof micros / sizeof micros[0]; i++){build_micro(&works[count++], &micros[i]);}
+    for(size_t i = 0; i < sizeof macros / sizeof macros[0]; i++){build_macro(&works[count++], &macros[i]);}
+
+    for(int i = 1; i < argc; i++){
+        const bool has_value = i + 1 < argc;
+        if(!strcmp(argv[i], "--insts") && has_value){insts = atoi(argv[++i]);}
+        else if(!strcmp(argv[i], "--reps") && has_value){reps = atoi(argv[++i]);}
+        else if(!strcmp(argv[i], "--ips") && has_value){ips = atoi(argv[++i]);}
+        else if(!strcmp(argv[i], "--json") && has_value){json_path = argv[++i];}
+        else if(argv[i][0] != '-' && count < MAX_WORKLOADS){if(!load_rom(&works[count], argv[i])){return EXIT_FAILURE;} count++;}
+        else{fprintf(stderr, "Usage: %s [--insts N] [--reps N] [--ips N] [--json out.json] [rom.ch8 ...]\n", argv[0]); return EXIT_FAILURE;}
+    }
+    if(insts <= 0 || reps <= 0 || ips <= 0){fprintf(stderr, "--insts, --reps and --ips must be above 0\n"); return EXIT_FAILURE;}
+
+    FILE *json = fopen(json_path, "w");
+    if(!json){fprintf(stderr, "Could not open %s for writing\n", json_path); return EXIT_FAILURE;}
+    fprintf(json, "{\n  \"insts\": %d,\n  \"reps\": %d,\n  \"ips\": %d,\n  \"results\": [", insts, reps, ips);
+
+    printf("%-6s %-24s %-9s %10s %10s %10s\n", "kind", "workload", "engine", "ns/inst", "stddev", "min");
+    bool first = true;
+    for(int w = 0; w < count; w++){
+        for(dispatch_type d = SWITCH; d <= JIT; d++){
+            const result_type r = measure(&works[w], d, insts, reps, ips);
+            printf("%-6s %-24s %-9s %10.3f %10.3f %10.3f\n", works[w].kind, works[w].name, engine_names[d], r.mean, r.stddev, r.min);
+            fprintf(json, "%s\n    {\"kind\": \"%s\", \"workload\": ", first ? "" : ",", works[w].kind);
+            json_string(json, works[w].name);
+            fprintf(json, ", \"engine\": \"%s\", \"ns_per_inst\": %.4f, \"stddev\": %.4f, \"min\": %.4f}", engine_names[d], r.mean, r.stddev, r.min);
+            first = false;
+        }
+    }
+    fprintf(json, "\n  ]\n}\n");
+    if(fclose(json) != 0){fprintf(stderr, "Could not write %s\n", json_path); return EXIT_FAILURE;}
+    printf("Wrote %s\n", json_path);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,630 @@
+#include "chip8.h"
+#include "ops.h"
+#include "jit.h"
+#ifdef CHIP8_AOT
+#include "aot.h"
+#endif
+
+//One profile per emu_type, adding an interpreter is just another row
+static const quirks_type quirk_profiles[] = {
+    [COSMAC] = {.shift_vy = true,  .jump_vx = false, .index_carry = false, .load_store_i = true,  .super_chip = false, .xo_chip = false},
+    [AMIGA]  = {.shift_vy = false, .jump_vx = true,  .index_carry = true,  .load_store_i = false, .super_chip = false, .xo_chip = false},
+    [SCHIP]  = {.shift_vy = false, .jump_vx = true,  .index_carry = false, .load_store_i = false, .super_chip = true,  .xo_chip = false},
+    [XOCHIP] = {.shift_vy = true,  .jump_vx = false, .index_carry = false, .load_store_i = true,  .super_chip = true,  .xo_chip = true},
+};
+
+//Which bits of NN are needed to tell opcodes apart, indexed by first nibble
+static const uint8_t decode_mask[16] = {
+    [0x0] = 0xFF, [0x8] = 0x0F, [0xE] = 0xFF, [0xF] = 0xFF,
+};
+
+//Two level decode table, first nibble then NN & decode_mask. Anything not listed is OP_NOP
+static const uint8_t decode_table[16][256] = {
+    [0x0][0xE0] = OP_00E0, [0x0][0xEE] = OP_00EE,
+    [0x0][0xC0] = OP_00CN, [0x0][0xC1] = OP_00CN, [0x0][0xC2] = OP_00CN, [0x0][0xC3] = OP_00CN,
+    [0x0][0xC4] = OP_00CN, [0x0][0xC5] = OP_00CN, [0x0][0xC6] = OP_00CN, [0x0][0xC7] = OP_00CN,
+    [0x0][0xC8] = OP_00CN, [0x0][0xC9] = OP_00CN, [0x0][0xCA] = OP_00CN, [0x0][0xCB] = OP_00CN,
+    [0x0][0xCC] = OP_00CN, [0x0][0xCD] = OP_00CN, [0x0][0xCE] = OP_00CN, [0x0][0xCF] = OP_00CN,
+    [0x0][0xFB] = OP_00FB, [0x0][0xFC] = OP_00FC, [0x0][0xFD] = OP_00FD, [0x0][0xFE] = OP_00FE, [0x0][0xFF] = OP_00FF,
+    [0x1][0x00] = OP_1NNN,
+    [0x2][0x00] = OP_2NNN,
+    [0x3][0x00] = OP_3XNN,
+    [0x4][0x00] = OP_4XNN,
+    [0x5][0x00] = OP_5XY0,
+    [0x6][0x00] = OP_6XNN,
+    [0x7][0x00] = OP_7XNN,
+    [0x8][0x00] = OP_8XY0, [0x8][0x01] = OP_8XY1, [0x8][0x02] = OP_8XY2, [0x8][0x03] = OP_8XY3,
+    [0x8][0x04] = OP_8XY4, [0x8][0x05] = OP_8XY5, [0x8][0x06] = OP_8XY6, [0x8][0x07] = OP_8XY7,
+    [0x8][0x0E] = OP_8XYE,
+    [0x9][0x00] = OP_9XY0,
+    [0xA][0x00] = OP_ANNN,
+    [0xB][0x00] = OP_BNNN,
+    [0xC][0x00] = OP_CXNN,
+    [0xD][0x00] = OP_DXYN,
+    [0xE][0x9E] = OP_EX9E, [0xE][0xA1] = OP_EXA1,
+    [0xF][0x07] = OP_FX07, [0xF][0x0A] = OP_FX0A, [0xF][0x15] = OP_FX15, [0xF][0x18] = OP_FX18,
+    [0xF][0x1E] = OP_FX1E, [0xF][0x29] = OP_FX29, [0xF][0x33] = OP_FX33, [0xF][0x55] = OP_FX55,
+    [0xF][0x65] = OP_FX65,
+    [0xF][0x02] = OP_F002, [0xF][0x3A] = OP_FX3A,
+    [0xF][0x30] = OP_FX30, [0xF][0x75] = OP_FX75, [0xF][0x85] = OP_FX85,
+};
+
+//Decode the instruction starting at addr into the cache
+void decode(chip8_type *chip8, uint16_t addr){
+    instr_type *inst = &chip8->cache[addr];
+
+    //Have to or 2 bytes as one opcode is 2 bytes long, the last address wraps so we never read past ram
+    inst->opcode.data[0] = chip8->ram[(addr+1) & 0x0FFF];
+    inst->opcode.data[1] = chip8->ram[addr];
+
+    inst->NNN = inst->opcode.full_op & 0x0FFF; // Immediate Memory address, we want to mask of the last 3 nibbles
+    inst->NN = inst->opcode.full_op & 0x0FF; // 8bit immediate number 
+    inst->N = inst->opcode.full_op & 0x0F; //N nibble 
+    inst->X = (inst->opcode.full_op >> 8) & 0x0F; // X register 
+    inst->Y = (inst->opcode.full_op >> 4) & 0x0F; // Y register
+
+    //First nibble picks the row, the mask picks which low bits (none, N or NN) tell opcodes in that row apart
+    const uint8_t row = (inst->opcode.full_op & 0xF000) >> 12;
+    inst->op = decode_table[row][inst->NN & decode_mask[row]];
+
+    //Swap in the quirk specific handler so emulate() never checks which interpreter it is
+    switch(inst->op){
+        case(OP_8XY6):{if(chip8->quirks->shift_vy){inst->op = OP_8XY6_VY;} break;}
+        case(OP_8XYE):{if(chip8->quirks->shift_vy){inst->op = OP_8XYE_VY;} break;}
+        case(OP_BNNN):{if(chip8->quirks->jump_vx){inst->op = OP_BXNN;} break;}
+        case(OP_FX1E):{if(chip8->quirks->index_carry){inst->op = OP_FX1E_VF;} break;}
+        case(OP_FX55):{if(chip8->quirks->load_store_i){inst->op = OP_FX55_I;} break;}
+        case(OP_FX65):{if(chip8->quirks->load_store_i){inst->op = OP_FX65_I;} break;}
+        case(OP_DXYN):{if(chip8->quirks->super_chip && inst->N == 0){inst->op = OP_DXY0;} break;}
+        case(OP_00CN): case(OP_00FB): case(OP_00FC): case(OP_00FD): case(OP_00FE): case(OP_00FF):
+        case(OP_FX30): case(OP_FX75): case(OP_FX85):{if(!chip8->quirks->super_chip){inst->op = OP_NOP;} break;}
+        case(OP_F002): case(OP_FX3A):{if(!chip8->quirks->xo_chip){inst->op = OP_NOP;} break;}
+    }
+    inst->base_op = inst->op; //fuse() decides if op becomes a pair once the next instruction is decoded too
+}
+
+//Pairs that show up back to back in nearly every ROM: sprite setup (6XNN 6YNN ANNN DXYN),
+//counter loops (7X01 3XNN 1NNN) and delay timer waits (FX07 3X00 1NNN). Add a row to fuse another
+static const struct{
+    uint8_t first;
+    uint8_t second;
+    uint8_t fused;
+} fusions[] = {
+    {OP_6XNN, OP_6XNN, OP_6XNN_6XNN},
+    {OP_ANNN, OP_DXYN, OP_ANNN_DXYN},
+    {OP_7XNN, OP_3XNN, OP_7XNN_3XNN},
+    {OP_FX07, OP_3XNN, OP_FX07_3XNN},
+};
+
+//Loops that can't do anything until the delay timer or keypad changes, OP_NOP if addr doesn't start one
+static uint8_t idle_loop(const chip8_type *chip8, uint16_t addr){
+    const instr_type *inst = &chip8->cache[addr];
+    switch(inst->base_op){
+        case(OP_1NNN):{return (inst->NNN == addr) ? OP_IDLE_1NNN : OP_NOP;}
+        case(OP_FX0A):{return OP_IDLE_FX0A;}
+        case(OP_FX07):{
+            if(addr > 0x0FFB){return OP_NOP;}
+            const bool wait = inst[2].base_op == OP_3XNN && inst[2].X == inst->X && inst[4].base_op == OP_1NNN && inst[4].NNN == addr;
+            return wait ? OP_IDLE_FX07 : OP_NOP;
+        }
+        default:{return OP_NOP;}
+    }
+}
+
+//Point the instruction at addr at an idle loop or a fused handler if it and the next instructions make one
+void fuse(chip8_type *chip8, uint16_t addr){
+    instr_type *inst = &chip8->cache[addr];
+    inst->op = inst->base_op;
+
+    const uint8_t idle = idle_loop(chip8, addr);
+    if(idle != OP_NOP){inst->op = idle; return;}
+    if(addr > 0x0FFD){return;} //Second half would be past the end of the cache
+
+    for(size_t i = 0; i < sizeof fusions / sizeof fusions[0]; i++){
+        if(inst->base_op == fusions[i].first && inst[2].base_op == fusions[i].second){inst->op = fusions[i].fused; return;}
+    }
+}
+
+//Ram from addr to addr+len was written to, redecode every instruction that overlaps it
+void invalidate(chip8_type *chip8, uint16_t addr, uint16_t len){
+    for(uint16_t i = 0; i <= len; i++){decode(chip8, (addr + i - 1) & 0x0FFF);} //Instruction starting one byte before addr also reads from it
+    for(uint16_t i = 0; i <= len + 4; i++){fuse(chip8, (addr + i - 5) & 0x0FFF);} //As do pairs and idle loops that reach into it
+    if(chip8->jit){jit_invalidate(chip8->jit, addr, len);} //Compiled blocks have the old instructions baked in too
+#ifdef CHIP8_AOT
+    if(chip8->aot_stale){aot_invalidate(chip8, addr, len);}
+#endif
+}
+
+//Same as init_chip8() with the program already in memory, for front ends that build their own (the bench)
+int init_chip8_program(chip8_type *chip8, const config_type *config, const uint8_t *program, size_t size){
+    const uint32_t entry = 0x200; //Entry point for roms to be loaded into memory
+    const uint8_t font[] = {
+        0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+        0x20, 0x60, 0x20, 0x20, 0x70, // 1
+        0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+        0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+        0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+        0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+        0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+        0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+        0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+        0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+        0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+        0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+        0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+        0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+        0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+        0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+    }; //Fonts used by the CHIP 8
+    const uint8_t big_font[] = {
+        0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+        0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+        0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+        0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+        0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+        0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+        0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+    }; //8x10 digits for SUPER-CHIP FX30
+
+
+    memset(chip8, 0, sizeof(chip8_type));
+
+    //Load Font
+    memcpy(chip8->ram, font, sizeof(font));
+    if(quirk_profiles[config->choice].super_chip){memcpy(&chip8->ram[BIG_FONT], big_font, sizeof(big_font));} //Other interpreters keep that ram zeroed like they always have
+
+    const size_t max_size = sizeof chip8->ram - entry; // Maximum size of memory that can be allocated to programs as the from 0x0 - 0x200 is not available
+    if(size > max_size){fprintf(stderr, "ROM size is too big, Max size: %zu, ROM size: %zu\n" , max_size, size); return 0;} // Return error if file size is too big 
+    memcpy(&chip8->ram[entry], program, size);
+
+    chip8->pc = entry;
+    chip8->state = RUNNING;
+    chip8->rom_name = config->rom_name;
+    chip8->quirks = &quirk_profiles[config->choice];
+    chip8->ips = config->insts_per_sec;
+    chip8->rng = config->seed ? config->seed : (uint32_t)time(NULL) | 1; //xorshift gets stuck on 0
+    memset(chip8->pattern, 0xF0, sizeof chip8->pattern); //Square wave, a plain 500Hz beep for ROMs that never load a pattern
+    chip8->pitch = 64;
+#ifdef CHIP8_PROFILE
+    chip8->profile.call_count = 1; //Just the root
+#endif
+
+    for(uint16_t addr = 0; addr < sizeof chip8->ram; addr++){decode(chip8, addr);} //Decode the whole ram once so emulate() only has to look up the cache
+    for(uint16_t addr = 0; addr < sizeof chip8->ram; addr++){fuse(chip8, addr);}
+
+    return 1; //Success
+}
+
+int init_chip8(chip8_type *chip8, config_type *config){
+    uint8_t program[4096 - 0x200];
+
+    //Open/Load ROM
+    FILE *rom = fopen(config->rom_name, "rb"); // Set File object to read bytes as the file is raw
+    if(!rom){fprintf(stderr, "ROM file %s is invalid or does not exist\n" ,config->rom_name); return 0;} //Return error if file cannot be opened
+
+    fseek(rom, SEEK_SET, SEEK_END); // Set the cursor of the file from start to end
+    const size_t rom_size = ftell(rom); // Using cursor, determines rom size
+    rewind(rom); //Rewind the cursor to read later
+    if(rom_size > sizeof program){fprintf(stderr, "ROM size is too big, Max size: %zu, ROM size: %zu\n" , sizeof program, rom_size); fclose(rom); return 0;} // Return error if file size is too big 
+
+    fread(program, rom_size, 1, rom);
+
+    fclose(rom); //Close rom file 
+
+    return init_chip8_program(chip8, config, program, rom_size);
+}
+
+bool check_keypad(chip8_type *chip8, uint8_t *key_value){
+    for(uint8_t i = 0; i < 16 && *key_value == 0xFF ; i++){if(chip8->keypad[i]){*key_value = i; return true;}}
+    return false;
+}
+
+
+const handler_type handlers[] = {
+    [OP_NOP] = op_nop,
+    [OP_00E0] = op_00E0, [OP_00EE] = op_00EE,
+    [OP_1NNN] = op_1NNN, [OP_2NNN] = op_2NNN,
+    [OP_3XNN] = op_3XNN, [OP_4XNN] = op_4XNN, [OP_5XY0] = op_5XY0,
+    [OP_6XNN] = op_6XNN, [OP_7XNN] = op_7XNN,
+    [OP_8XY0] = op_8XY0, [OP_8XY1] = op_8XY1, [OP_8XY2] = op_8XY2, [OP_8XY3] = op_8XY3,
+    [OP_8XY4] = op_8XY4, [OP_8XY5] = op_8XY5, [OP_8XY6] = op_8XY6, [OP_8XY6_VY] = op_8XY6_VY,
+    [OP_8XY7] = op_8XY7, [OP_8XYE] = op_8XYE, [OP_8XYE_VY] = op_8XYE_VY,
+    [OP_9XY0] = op_9XY0,
+    [OP_ANNN] = op_ANNN, [OP_BNNN] = op_BNNN, [OP_BXNN] = op_BXNN, [OP_CXNN] = op_CXNN, [OP_DXYN] = op_DXYN,
+    [OP_EX9E] = op_EX9E, [OP_EXA1] = op_EXA1,
+    [OP_FX07] = op_FX07, [OP_FX0A] = op_FX0A, [OP_FX15] = op_FX15, [OP_FX18] = op_FX18,
+    [OP_FX1E] = op_FX1E, [OP_FX1E_VF] = op_FX1E_VF, [OP_FX29] = op_FX29, [OP_FX33] = op_FX33,
+    [OP_FX55] = op_FX55, [OP_FX55_I] = op_FX55_I, [OP_FX65] = op_FX65, [OP_FX65_I] = op_FX65_I,
+    [OP_F002] = op_F002, [OP_FX3A] = op_FX3A,
+    [OP_00CN] = op_00CN, [OP_00FB] = op_00FB, [OP_00FC] = op_00FC, [OP_00FD] = op_00FD, [OP_00FE] = op_00FE, [OP_00FF] = op_00FF,
+    [OP_DXY0] = op_DXY0, [OP_FX30] = op_FX30, [OP_FX75] = op_FX75, [OP_FX85] = op_FX85,
+    [OP_6XNN_6XNN] = op_6XNN_6XNN, [OP_ANNN_DXYN] = op_ANNN_DXYN, [OP_7XNN_3XNN] = op_7XNN_3XNN, [OP_FX07_3XNN] = op_FX07_3XNN,
+};
+
+//Name of every op_type, the aot tool writes these into generated code and the profile report prints them
+const char *const op_names[] = {
+    [OP_NOP] = "OP_NOP",
+    [OP_00E0] = "OP_00E0", [OP_00EE] = "OP_00EE",
+    [OP_1NNN] = "OP_1NNN", [OP_2NNN] = "OP_2NNN",
+    [OP_3XNN] = "OP_3XNN", [OP_4XNN] = "OP_4XNN", [OP_5XY0] = "OP_5XY0",
+    [OP_6XNN] = "OP_6XNN", [OP_7XNN] = "OP_7XNN",
+    [OP_8XY0] = "OP_8XY0", [OP_8XY1] = "OP_8XY1", [OP_8XY2] = "OP_8XY2", [OP_8XY3] = "OP_8XY3",
+    [OP_8XY4] = "OP_8XY4", [OP_8XY5] = "OP_8XY5", [OP_8XY6] = "OP_8XY6", [OP_8XY6_VY] = "OP_8XY6_VY",
+    [OP_8XY7] = "OP_8XY7", [OP_8XYE] = "OP_8XYE", [OP_8XYE_VY] = "OP_8XYE_VY",
+    [OP_9XY0] = "OP_9XY0",
+    [OP_ANNN] = "OP_ANNN", [OP_BNNN] = "OP_BNNN", [OP_BXNN] = "OP_BXNN", [OP_CXNN] = "OP_CXNN", [OP_DXYN] = "OP_DXYN",
+    [OP_EX9E] = "OP_EX9E", [OP_EXA1] = "OP_EXA1",
+    [OP_FX07] = "OP_FX07", [OP_FX0A] = "OP_FX0A", [OP_FX15] = "OP_FX15", [OP_FX18] = "OP_FX18",
+    [OP_FX1E] = "OP_FX1E", [OP_FX1E_VF] = "OP_FX1E_VF", [OP_FX29] = "OP_FX29", [OP_FX33] = "OP_FX33",
+    [OP_FX55] = "OP_FX55", [OP_FX55_I] = "OP_FX55_I", [OP_FX65] = "OP_FX65", [OP_FX65_I] = "OP_FX65_I",
+    [OP_F002] = "OP_F002", [OP_FX3A] = "OP_FX3A",
+    [OP_00CN] = "OP_00CN", [OP_00FB] = "OP_00FB", [OP_00FC] = "OP_00FC", [OP_00FD] = "OP_00FD", [OP_00FE] = "OP_00FE", [OP_00FF] = "OP_00FF",
+    [OP_DXY0] = "OP_DXY0", [OP_FX30] = "OP_FX30", [OP_FX75] = "OP_FX75", [OP_FX85] = "OP_FX85",
+    [OP_6XNN_6XNN] = "OP_6XNN_6XNN", [OP_ANNN_DXYN] = "OP_ANNN_DXYN", [OP_7XNN_3XNN] = "OP_7XNN_3XNN", [OP_FX07_3XNN] = "OP_FX07_3XNN",
+    [OP_IDLE_1NNN] = "OP_IDLE_1NNN", [OP_IDLE_FX07] = "OP_IDLE_FX07", [OP_IDLE_FX0A] = "OP_IDLE_FX0A",
+};
+
+#ifdef CHIP8_PROFILE
+//Count n instructions, then follow the call if it was one. A call is counted against the caller and a
+//return against the callee, so every instruction lands in exactly one frame
+static void profile_count(chip8_type *chip8, const instr_type *inst, uint8_t op, int n){
+    chip8->profile.ops[op] += n;
+    chip8->profile.pcs[inst - chip8->cache] += n;
+    chip8->profile.calls[chip8->profile.current].self += n;
+
+    if(op == OP_2NNN){
+        const uint16_t caller = chip8->profile.current;
+        uint16_t node = chip8->profile.calls[caller].child;
+        while(node && chip8->profile.calls[node].addr != inst->NNN){node = chip8->profile.calls[node].sibling;}
+        if(!node && chip8->profile.call_count < PROFILE_MAX_CALLS){
+            node = chip8->profile.call_count++;
+            chip8->profile.calls[node].addr = inst->NNN;
+            chip8->profile.calls[node].parent = caller;
+            chip8->profile.calls[node].sibling = chip8->profile.calls[caller].child;
+            chip8->profile.calls[caller].child = node;
+        }
+        if(node){chip8->profile.current = node;}
+        else{chip8->profile.overflow++;} //Out of nodes, stays with the caller until the matching 00EE
+    }
+    else if(op == OP_00EE && chip8->profile.overflow){chip8->profile.overflow--;}
+    //Returning past the root happens after loading a state from deeper in the game, stay at the root
+    else if(op == OP_00EE){chip8->profile.current = chip8->profile.calls[chip8->profile.current].parent;}
+}
+#define PROFILE(inst, op, n) profile_count(chip8, inst, op, n)
+#else
+#define PROFILE(inst, op, n) ((void)0) //Compiled out, emulate() is exactly what it is without profiling
+#endif
+
+//Run the instruction at pc, or the fused pair starting there if budget has room for both. Returns how many ran
+int emulate(chip8_type *chip8, int budget){
+    //Instruction was fetched and decoded when it was loaded into ram
+    const instr_type *inst = &chip8->cache[chip8->pc & 0x0FFF];
+    const uint8_t op = (budget >= 2) ? inst->op : inst->base_op;
+
+    chip8->pc += 2;
+
+    switch(op){
+        case(OP_NOP):{break;}
+        case(OP_00E0):{op_00E0(chip8, inst); break;}
+        case(OP_00EE):{op_00EE(chip8, inst); break;}
+        case(OP_1NNN):{op_1NNN(chip8, inst); break;}
+        case(OP_2NNN):{op_2NNN(chip8, inst); break;}
+        case(OP_3XNN):{op_3XNN(chip8, inst); break;}
+        case(OP_4XNN):{op_4XNN(chip8, inst); break;}
+        case(OP_5XY0):{op_5XY0(chip8, inst); break;}
+        case(OP_6XNN):{op_6XNN(chip8, inst); break;}
+        case(OP_7XNN):{op_7XNN(chip8, inst); break;}
+        case(OP_8XY0):{op_8XY0(chip8, inst); break;}
+        case(OP_8XY1):{op_8XY1(chip8, inst); break;}
+        case(OP_8XY2):{op_8XY2(chip8, inst); break;}
+        case(OP_8XY3):{op_8XY3(chip8, inst); break;}
+        case(OP_8XY4):{op_8XY4(chip8, inst); break;}
+        case(OP_8XY5):{op_8XY5(chip8, inst); break;}
+        case(OP_8XY6):{op_8XY6(chip8, inst); break;}
+        case(OP_8XY6_VY):{op_8XY6_VY(chip8, inst); break;}
+        case(OP_8XY7):{op_8XY7(chip8, inst); break;}
+        case(OP_8XYE):{op_8XYE(chip8, inst); break;}
+        case(OP_8XYE_VY):{op_8XYE_VY(chip8, inst); break;}
+        case(OP_9XY0):{op_9XY0(chip8, inst); break;}
+        case(OP_ANNN):{op_ANNN(chip8, inst); break;}
+        case(OP_BNNN):{op_BNNN(chip8, inst); break;}
+        case(OP_BXNN):{op_BXNN(chip8, inst); break;}
+        case(OP_CXNN):{op_CXNN(chip8, inst); break;}
+        case(OP_DXYN):{op_DXYN(chip8, inst); break;}
+        case(OP_EX9E):{op_EX9E(chip8, inst); break;}
+        case(OP_EXA1):{op_EXA1(chip8, inst); break;}
+        case(OP_FX07):{op_FX07(chip8, inst); break;}
+        case(OP_FX0A):{op_FX0A(chip8, inst); break;}
+        case(OP_FX15):{op_FX15(chip8, inst); break;}
+        case(OP_FX18):{op_FX18(chip8, inst); break;}
+        case(OP_FX1E):{op_FX1E(chip8, inst); break;}
+        case(OP_FX1E_VF):{op_FX1E_VF(chip8, inst); break;}
+        case(OP_FX29):{op_FX29(chip8, inst); break;}
+        case(OP_FX33):{op_FX33(chip8, inst); break;}
+        case(OP_FX55):{op_FX55(chip8, inst); break;}
+        case(OP_FX55_I):{op_FX55_I(chip8, inst); break;}
+        case(OP_FX65):{op_FX65(chip8, inst); break;}
+        case(OP_FX65_I):{op_FX65_I(chip8, inst); break;}
+        case(OP_F002):{op_F002(chip8, inst); break;}
+        case(OP_FX3A):{op_FX3A(chip8, inst); break;}
+        case(OP_00CN):{op_00CN(chip8, inst); break;}
+        case(OP_00FB):{op_00FB(chip8, inst); break;}
+        case(OP_00FC):{op_00FC(chip8, inst); break;}
+        case(OP_00FD):{op_00FD(chip8, inst); break;}
+        case(OP_00FE):{op_00FE(chip8, inst); break;}
+        case(OP_00FF):{op_00FF(chip8, inst); break;}
+        case(OP_DXY0):{op_DXY0(chip8, inst); break;}
+        case(OP_FX30):{op_FX30(chip8, inst); break;}
+        case(OP_FX75):{op_FX75(chip8, inst); break;}
+        case(OP_FX85):{op_FX85(chip8, inst); break;}
+        case(OP_6XNN_6XNN):{op_6XNN_6XNN(chip8, inst); break;}
+        case(OP_ANNN_DXYN):{op_ANNN_DXYN(chip8, inst); break;}
+        case(OP_7XNN_3XNN):{op_7XNN_3XNN(chip8, inst); break;}
+        case(OP_FX07_3XNN):{op_FX07_3XNN(chip8, inst); break;}
+        case(OP_IDLE_1NNN): case(OP_IDLE_FX07): case(OP_IDLE_FX0A):{
+            const int ran = op_idle(chip8, inst, op, budget);
+            chip8->cycles += ran;
+            PROFILE(inst, op, ran);
+            return ran;
+        }
+    }
+    chip8->cycles += op_count(op);
+    PROFILE(inst, op, op_count(op));
+    return op_count(op);
+}
+
+void run_switch(chip8_type *chip8, int count){
+    while(count > 0){count -= emulate(chip8, count);}
+}
+
+void run_table(chip8_type *chip8, int count){
+    const uint64_t end = chip8->cycles + count;
+    while(count >= 2){
+        const instr_type *inst = &chip8->cache[chip8->pc & 0x0FFF];
+        const uint8_t op = inst->op; //Read before the call, FX33/FX55 can redecode inst
+        chip8->pc += 2;
+        chip8->cycles = end - count;
+        if(op >= OP_IDLE_1NNN){count -= op_idle(chip8, inst, op, count); continue;}
+        handlers[op](chip8, inst);
+        count -= op_count(op);
+    }
+    if(count > 0){
+        const instr_type *inst = &chip8->cache[chip8->pc & 0x0FFF];
+        chip8->pc += 2;
+        chip8->cycles = end - 1;
+        handlers[inst->base_op](chip8, inst); //No room left for a pair
+    }
+    chip8->cycles = end;
+}
+
+#if defined(__GNUC__)
+//Every handler ends by jumping straight to the next one, so there is no shared dispatch branch to mispredict
+void run_threaded(chip8_type *chip8, int count){
+    static void *const labels[] = {
+        [OP_NOP] = &&L_NOP,
+        [OP_00E0] = &&L_00E0, [OP_00EE] = &&L_00EE,
+        [OP_1NNN] = &&L_1NNN, [OP_2NNN] = &&L_2NNN,
+        [OP_3XNN] = &&L_3XNN, [OP_4XNN] = &&L_4XNN, [OP_5XY0] = &&L_5XY0,
+        [OP_6XNN] = &&L_6XNN, [OP_7XNN] = &&L_7XNN,
+        [OP_8XY0] = &&L_8XY0, [OP_8XY1] = &&L_8XY1, [OP_8XY2] = &&L_8XY2, [OP_8XY3] = &&L_8XY3,
+        [OP_8XY4] = &&L_8XY4, [OP_8XY5] = &&L_8XY5, [OP_8XY6] = &&L_8XY6, [OP_8XY6_VY] = &&L_8XY6_VY,
+        [OP_8XY7] = &&L_8XY7, [OP_8XYE] = &&L_8XYE, [OP_8XYE_VY] = &&L_8XYE_VY,
+        [OP_9XY0] = &&L_9XY0,
+        [OP_ANNN] = &&L_ANNN, [OP_BNNN] = &&L_BNNN, [OP_BXNN] = &&L_BXNN, [OP_CXNN] = &&L_CXNN, [OP_DXYN] = &&L_DXYN,
+        [OP_EX9E] = &&L_EX9E, [OP_EXA1] = &&L_EXA1,
+        [OP_FX07] = &&L_FX07, [OP_FX0A] = &&L_FX0A, [OP_FX15] = &&L_FX15, [OP_FX18] = &&L_FX18,
+        [OP_FX1E] = &&L_FX1E, [OP_FX1E_VF] = &&L_FX1E_VF, [OP_FX29] = &&L_FX29, [OP_FX33] = &&L_FX33,
+        [OP_FX55] = &&L_FX55, [OP_FX55_I] = &&L_FX55_I, [OP_FX65] = &&L_FX65, [OP_FX65_I] = &&L_FX65_I,
+        [OP_F002] = &&L_F002, [OP_FX3A] = &&L_FX3A,
+        [OP_00CN] = &&L_00CN, [OP_00FB] = &&L_00FB, [OP_00FC] = &&L_00FC, [OP_00FD] = &&L_00FD, [OP_00FE] = &&L_00FE, [OP_00FF] = &&L_00FF,
+        [OP_DXY0] = &&L_DXY0, [OP_FX30] = &&L_FX30, [OP_FX75] = &&L_FX75, [OP_FX85] = &&L_FX85,
+        [OP_6XNN_6XNN] = &&L_6XNN_6XNN, [OP_ANNN_DXYN] = &&L_ANNN_DXYN, [OP_7XNN_3XNN] = &&L_7XNN_3XNN, [OP_FX07_3XNN] = &&L_FX07_3XNN,
+        [OP_IDLE_1NNN] = &&L_IDLE, [OP_IDLE_FX07] = &&L_IDLE, [OP_IDLE_FX0A] = &&L_IDLE,
+    };
+    const instr_type *inst;
+    const uint64_t end = chip8->cycles + count;
+
+    //Budget check stays out of the hot path, only the last instruction of a batch can't take a fused pair.
+    //DISPATCH() counts one instruction, the fused labels count their second one themselves.
+    //Only the labels that touch a timer bring chip8->cycles up to date first, see SYNC()
+    #define DISPATCH() do{ \
+        if(count < 2){goto last;} \
+        count--; \
+        inst = &chip8->cache[chip8->pc & 0x0FFF]; \
+        chip8->pc += 2; \
+        goto *labels[inst->op]; \
+    }while(0)
+    #define SYNC(n) (chip8->cycles = end - count - (n)) //n is how many instructions the label has counted
+
+    DISPATCH();
+    last:
+    if(count <= 0){chip8->cycles = end; return;}
+    count = 0;
+    inst = &chip8->cache[chip8->pc & 0x0FFF];
+    chip8->pc += 2;
+    goto *labels[inst->base_op];
+
+    L_NOP: DISPATCH();
+    L_00E0: op_00E0(chip8, inst); DISPATCH();
+    L_00EE: op_00EE(chip8, inst); DISPATCH();
+    L_1NNN: op_1NNN(chip8, inst); DISPATCH();
+    L_2NNN: op_2NNN(chip8, inst); DISPATCH();
+    L_3XNN: op_3XNN(chip8, inst); DISPATCH();
+    L_4XNN: op_4XNN(chip8, inst); DISPATCH();
+    L_5XY0: op_5XY0(chip8, inst); DISPATCH();
+    L_6XNN: op_6XNN(chip8, inst); DISPATCH();
+    L_7XNN: op_7XNN(chip8, inst); DISPATCH();
+    L_8XY0: op_8XY0(chip8, inst); DISPATCH();
+    L_8XY1: op_8XY1(chip8, inst); DISPATCH();
+    L_8XY2: op_8XY2(chip8, inst); DISPATCH();
+    L_8XY3: op_8XY3(chip8, inst); DISPATCH();
+    L_8XY4: op_8XY4(chip8, inst); DISPATCH();
+    L_8XY5: op_8XY5(chip8, inst); DISPATCH();
+    L_8XY6: op_8XY6(chip8, inst); DISPATCH();
+    L_8XY6_VY: op_8XY6_VY(chip8, inst); DISPATCH();
+    L_8XY7: op_8XY7(chip8, inst); DISPATCH();
+    L_8XYE: op_8XYE(chip8, inst); DISPATCH();
+    L_8XYE_VY: op_8XYE_VY(chip8, inst); DISPATCH();
+    L_9XY0: op_9XY0(chip8, inst); DISPATCH();
+    L_ANNN: op_ANNN(chip8, inst); DISPATCH();
+    L_BNNN: op_BNNN(chip8, inst); DISPATCH();
+    L_BXNN: op_BXNN(chip8, inst); DISPATCH();
+    L_CXNN: op_CXNN(chip8, inst); DISPATCH();
+    L_DXYN: op_DXYN(chip8, inst); DISPATCH();
+    L_EX9E: op_EX9E(chip8, inst); DISPATCH();
+    L_EXA1: op_EXA1(chip8, inst); DISPATCH();
+    L_FX07: SYNC(1); op_FX07(chip8, inst); DISPATCH();
+    L_FX0A: op_FX0A(chip8, inst); DISPATCH();
+    L_FX15: SYNC(1); op_FX15(chip8, inst); DISPATCH();
+    L_FX18: SYNC(1); op_FX18(chip8, inst); DISPATCH();
+    L_FX1E: op_FX1E(chip8, inst); DISPATCH();
+    L_FX1E_VF: op_FX1E_VF(chip8, inst); DISPATCH();
+    L_FX29: op_FX29(chip8, inst); DISPATCH();
+    L_FX33: op_FX33(chip8, inst); DISPATCH();
+    L_FX55: op_FX55(chip8, inst); DISPATCH();
+    L_FX55_I: op_FX55_I(chip8, inst); DISPATCH();
+    L_FX65: op_FX65(chip8, inst); DISPATCH();
+    L_FX65_I: op_FX65_I(chip8, inst); DISPATCH();
+    L_F002: op_F002(chip8, inst); DISPATCH();
+    L_FX3A: op_FX3A(chip8, inst); DISPATCH();
+    L_00CN: op_00CN(chip8, inst); DISPATCH();
+    L_00FB: op_00FB(chip8, inst); DISPATCH();
+    L_00FC: op_00FC(chip8, inst); DISPATCH();
+    L_00FD: op_00FD(chip8, inst); DISPATCH();
+    L_00FE: op_00FE(chip8, inst); DISPATCH();
+    L_00FF: op_00FF(chip8, inst); DISPATCH();
+    L_DXY0: op_DXY0(chip8, inst); DISPATCH();
+    L_FX30: op_FX30(chip8, inst); DISPATCH();
+    L_FX75: op_FX75(chip8, inst); DISPATCH();
+    L_FX85: op_FX85(chip8, inst); DISPATCH();
+    L_6XNN_6XNN: count--; op_6XNN_6XNN(chip8, inst); DISPATCH();
+    L_ANNN_DXYN: count--; op_ANNN_DXYN(chip8, inst); DISPATCH();
+    L_7XNN_3XNN: count--; op_7XNN_3XNN(chip8, inst); DISPATCH();
+    L_FX07_3XNN: count--; SYNC(2); op_FX07_3XNN(chip8, inst); DISPATCH();
+    L_IDLE: SYNC(1); count -= op_idle(chip8, inst, inst->op, count + 1) - 1; DISPATCH(); //DISPATCH() already took one off
+
+    #undef SYNC
+    #undef DISPATCH
+}
+#endif
+
+//Pick the engine once at startup so the main loop never has to check
+engine_type select_engine(chip8_type *chip8, const config_type *config){
+#ifdef CHIP8_PROFILE
+    if(config->dispatch != SWITCH){fprintf(stderr, "Profile builds only count in emulate(), using switch dispatch\n");}
+    return run_switch;
+#endif
+    switch(config->dispatch){
+        case(TABLE):{return run_table;}
+        case(AOT):{
+#ifdef CHIP8_AOT
+            if(aot_matches(chip8, config)){
+                chip8->aot_stale = calloc(aot_block_count, sizeof(bool));
+                if(chip8->aot_stale){return run_aot;}
+            }
+            fprintf(stderr, "Built in AOT code is for a different ROM or emulator_type, using the JIT instead\n");
+#else
+            fprintf(stderr, "Built without AOT code, using the JIT instead\n");
+#endif
+        } //fall through
+        case(JIT):{
+            chip8->jit = jit_create();
+            if(chip8->jit){return run_jit;}
+            fprintf(stderr, "JIT needs Linux on x86-64, using threaded dispatch instead\n");
+        } //fall through
+        case(THREADED):{
+#if defined(__GNUC__)
+            return run_threaded;
+#else
+            fprintf(stderr, "Threaded dispatch needs GCC or Clang, using the handler table instead\n");
+            return run_table;
+#endif
+        }
+        default:{return run_switch;}
+    }
+}
+
+//The 60Hz timers tick as each 1/60th of a second's worth of instructions finishes, the same boundaries
+//the frame scheduler splits instructions on, so a timer reads the same whatever the batch size.
+//Tick k has happened by cycle c once k * ips / 60 <= c
+uint64_t timer_ticks(const chip8_type *chip8, uint64_t cycle){
+    return ((cycle + 1) * 60 + chip8->ips - 1) / chip8->ips - 1;
+}
+
+//First cycle tick has happened by
+uint64_t tick_cycle(const chip8_type *chip8, uint64_t tick){
+    return tick * chip8->ips / 60;
+}
+
+//Value a timer that runs out on tick expires reads at cycle, nothing has to count it down
+uint8_t read_timer(const chip8_type *chip8, uint64_t expires, uint64_t cycle){
+    const uint64_t now = timer_ticks(chip8, cycle);
+    return (expires > now) ? (uint8_t)(expires - now) : 0;
+}
+
+//Tick a timer set to value now runs out on
+uint64_t set_timer(const chip8_type *chip8, uint8_t value){
+    return timer_ticks(chip8, chip8->cycles) + value;
+}
+
+#ifdef CHIP8_PROFILE
+#define PROFILE_TOP_PCS 20
+
+static const uint64_t *sort_counts; //qsort has no context argument
+static int by_count(const void *a, const void *b){
+    const uint64_t x = sort_counts[*(const uint16_t *)a], y = sort_counts[*(const uint16_t *)b];
+    return (x < y) - (x > y);
+}
+
+//Where the instructions went, by handler and by address
+void profile_report(const chip8_type *chip8, FILE *out){
+    uint64_t total = 0;
+    for(int op = 0; op < OP_COUNT; op++){total += chip8->profile.ops[op];}
+    if(!total){fprintf(out, "Profile: nothing has run yet\n"); return;}
+
+    uint16_t order[4096];
+    for(uint16_t i = 0; i < OP_COUNT; i++){order[i] = i;}
+    sort_counts = chip8->profile.ops;
+    qsort(order, OP_COUNT, sizeof order[0], by_count);
+    fprintf(out, "Profile: %llu instructions\nBy handler:\n", (unsigned long long)total);
+    for(int i = 0; i < OP_COUNT && chip8->profile.ops[order[i]]; i++){
+        const uint64_t n = chip8->profile.ops[order[i]];
+        fprintf(out, "  %-14s %14llu %6.2f%%\n", op_names[order[i]], (unsigned long long)n, 100.0 * n / total);
+    }
+
+    for(uint16_t i = 0; i < 4096; i++){order[i] = i;}
+    sort_counts = chip8->profile.pcs;
+    qsort(order, 4096, sizeof order[0], by_count);
+    fprintf(out, "Hottest addresses:\n");
+    for(int i = 0; i < PROFILE_TOP_PCS && chip8->profile.pcs[order[i]]; i++){
+        const uint64_t n = chip8->profile.pcs[order[i]];
+        const instr_type *inst = &chip8->cache[order[i]];
+        fprintf(out, "  0x%03X %04X %-14s %14llu %6.2f%%\n", order[i], inst->opcode.full_op, op_names[inst->op], (unsigned long long)n, 100.0 * n / total);
+    }
+}
+
+//Call tree in folded stack form, one line per call path: main;sub_2A0;sub_31C <instructions>.
+//flamegraph.pl, speedscope and inferno all read it
+void profile_folded(const chip8_type *chip8, FILE *out){
+    for(uint16_t node = 0; node < chip8->profile.call_count; node++){
+        if(!chip8->profile.calls[node].self){continue;}
+
+        uint16_t path[PROFILE_MAX_CALLS];
+        int depth = 0;
+        for(uint16_t n = node; n; n = chip8->profile.calls[n].parent){path[depth++] = n;}
+
+        fprintf(out, "main");
+        while(depth > 0){fprintf(out, ";sub_%03X", chip8->profile.calls[path[--depth]].addr);}
+        fprintf(out, " %llu\n", (unsigned long long)chip8->profile.calls[node].self);
+    }
+}
+#endif
@@ -0,0 +1,235 @@
+#ifndef CHIP8_H
+#define CHIP8_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+//Emulator core, nothing in here knows about SDL so other front ends (and the JIT) can share it
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum{
+    COSMAC,
+    AMIGA, 
+    SCHIP,
+    XOCHIP,
+}emu_type;
+
+//Behaviour that differs between interpreters, decode() bakes these into the handler it picks
+typedef struct{
+    bool shift_vy;      //8XY6/8XYE shift VY into VX instead of shifting VX in place
+    bool jump_vx;       //BNNN jumps to XNN + VX instead of NNN + V0
+    bool index_carry;   //FX1E sets VF when I goes past 0xFFF
+    bool load_store_i;  //FX55/FX65 leave I at X + 1
+    bool super_chip;    //SUPER-CHIP opcodes: 128x64 hi-res, scrolls, 16x16 DXY0 sprites, the big font and FX75/FX85
+    bool xo_chip;       //XO-CHIP audio opcodes: F002 loads the pattern, FX3A sets the pitch
+} quirks_type;
+
+#define BIG_FONT 0x50 //SUPER-CHIP 8x10 digits FX30 points I at, straight after the 4x5 font
+
+//How emulate() gets from an opcode to the code that runs it
+typedef enum{
+    SWITCH,   //One switch over the predecoded handler
+    TABLE,    //Call through a table of handler functions
+    THREADED, //Computed goto straight to the next handler (GCC/Clang only, falls back to TABLE)
+    JIT,      //Compile basic blocks to x86-64 (Linux only, falls back to THREADED)
+    AOT,      //Blocks generated ahead of time by the aot tool (needs a build with CHIP8_AOT, falls back to JIT)
+}dispatch_type;
+
+
+//Config Object
+typedef struct {
+    emu_type choice;
+    uint32_t bg_colour;
+    uint32_t fg_colour;
+    int res_x;
+    int res_y;
+    char rom_name[50];
+    int insts_per_sec;
+    int sf;
+    dispatch_type dispatch;
+    uint32_t seed; //CXNN random number seed, 0 picks one from the clock
+    int rewind_seconds; //History Backspace can rewind through, 0 turns rewind off
+    int audio_samples; //Audio buffer size in samples, smaller is lower latency but needs the callback more often
+    int volume; //0 to 100
+} config_type;
+
+
+//Enum for emulation state
+typedef enum{
+    QUIT,
+    RUNNING,
+    PAUSED,
+} emu_state;
+
+typedef union{
+    uint16_t full_op;
+    uint8_t data[2];
+} opcode_t;
+
+//Handler an instruction is predecoded to, named after the opcode it implements
+typedef enum{
+    OP_NOP, //Unknown opcodes (and 0NNN) do nothing
+    OP_00E0,
+    OP_00EE,
+    OP_1NNN,
+    OP_2NNN,
+    OP_3XNN,
+    OP_4XNN,
+    OP_5XY0,
+    OP_6XNN,
+    OP_7XNN,
+    OP_8XY0,
+    OP_8XY1,
+    OP_8XY2,
+    OP_8XY3,
+    OP_8XY4,
+    OP_8XY5,
+    OP_8XY6,
+    OP_8XY6_VY,
+    OP_8XY7,
+    OP_8XYE,
+    OP_8XYE_VY,
+    OP_9XY0,
+    OP_ANNN,
+    OP_BNNN,
+    OP_BXNN,
+    OP_CXNN,
+    OP_DXYN,
+    OP_EX9E,
+    OP_EXA1,
+    OP_FX07,
+    OP_FX0A,
+    OP_FX15,
+    OP_FX18,
+    OP_FX1E,
+    OP_FX1E_VF,
+    OP_FX29,
+    OP_FX33,
+    OP_FX55,
+    OP_FX55_I,
+    OP_FX65,
+    OP_FX65_I,
+    OP_F002,  //XO-CHIP, load the audio pattern
+    OP_FX3A,  //XO-CHIP, set the audio pitch
+    OP_00CN,  //SUPER-CHIP from here to OP_FX85, decode() turns them into OP_NOP for the other interpreters
+    OP_00FB,
+    OP_00FC,
+    OP_00FD,
+    OP_00FE,
+    OP_00FF,
+    OP_DXY0,
+    OP_FX30,
+    OP_FX75,
+    OP_FX85,
+
+    //Fused pairs, fuse() puts these on the first instruction of the pair. Keep them after the single ops, op_count() relies on it
+    OP_6XNN_6XNN,
+    OP_ANNN_DXYN,
+    OP_7XNN_3XNN,
+    OP_FX07_3XNN,
+
+    //Idle loops, fuse() puts these on the instruction every trip round the loop starts at. Engines hand
+    //them the whole budget through op_idle() instead of counting them with op_count()
+    OP_IDLE_1NNN,  //1NNN that jumps to itself
+    OP_IDLE_FX07,  //FX07 3XNN 1NNN back to the FX07, a delay timer wait
+    OP_IDLE_FX0A,  //FX0A, waiting on a key
+
+    OP_COUNT,
+} op_type;
+
+typedef struct{
+    opcode_t opcode;
+    uint16_t NNN;   //Constants in instruction set, declaring like this would decrease space complexity
+    uint8_t NN;     
+    uint8_t N;      
+    uint8_t X;      
+    uint8_t Y;      
+    uint8_t op;     //Predecoded handler, see op_type. May be a fused pair
+    uint8_t base_op; //Handler for this instruction alone, used when there is no budget left for the pair
+} instr_type;
+
+#define PROFILE_MAX_CALLS 4096 //Distinct call paths the profile build tracks, deeper or later ones count against their caller
+
+//Chip 8 object
+typedef struct{
+    emu_state state;
+    uint8_t ram[4096]; //Ram for the chip 8
+    uint64_t display[64][2]; //Two words per row, bit 63 of the first is x = 0. DXYN draws a whole sprite row with a shift and an XOR per word. Low res only uses the first word of the first 32 rows
+    bool hires; //SUPER-CHIP 128x64 mode, 64x32 otherwise
+    uint8_t flags[16]; //SUPER-CHIP user flags FX75/FX85 save to and load from
+    uint16_t stack[48]; 
+    uint8_t sp; //Next free slot in stack, an index rather than a pointer so the whole state can be copied
+    uint8_t V[16]; //Registers from V0-Vf
+    uint16_t I; //Index Register  
+    uint16_t pc;
+    uint64_t cycles; //Instructions run since the ROM was loaded, the timers are worked out from it
+    int ips; //insts_per_sec, the 60Hz timers tick 60 times in this many cycles
+    uint64_t delay_expires; //60Hz tick the delay timer reads 0 from, see read_timer()
+    uint64_t sound_expires; //Same for the sound timer
+    uint8_t pattern[16]; //XO-CHIP audio, 128 one bit samples played while the sound timer runs, bit 7 of byte 0 first
+    uint8_t pitch; //XO-CHIP audio, the pattern plays at 4000*2^((pitch-64)/48) samples a second
+    uint32_t rng; //xorshift32 state for CXNN, never 0
+    bool keypad[16]; //Check if keypad is in off or on state
+    const char *rom_name; // Get a command line dir for rom to load into ram
+    instr_type cache[4096]; //Predecoded instruction starting at every address in ram, so emulate() never has to fetch or decode
+    bool draw;
+    const quirks_type *quirks; //Profile picked from config, only decode() looks at it
+    struct jit *jit; //Block cache for the JIT engine, NULL for every other engine
+    bool *aot_stale; //One per AOT block, set once a write changes the code it was generated from. NULL unless AOT is running
+#ifdef CHIP8_PROFILE
+    struct{
+        uint64_t ops[OP_COUNT]; //Instructions run by each handler, a fused pair counts 2 against the pair
+        uint64_t pcs[4096];     //Instructions run starting at each address
+        struct{
+            uint16_t addr;      //Subroutine entry point, 0 for the root (the code that was never called)
+            uint16_t parent, child, sibling; //Indexes into calls, 0 is the root so it also means none
+            uint64_t self;      //Instructions run in this subroutine on this call path, not counting its callees
+        } calls[PROFILE_MAX_CALLS]; //Call tree built from 2NNN/00EE as they run
+        uint16_t call_count;
+        uint16_t current;       //Node the running code belongs to
+        uint32_t overflow;      //Calls made while out of nodes and not returned from yet, their 00EEs must not pop current
+    } profile;
+#endif
+} chip8_type;
+
+//Runs count instructions, one per dispatch engine. Engines keep chip8->cycles right for every
+//instruction that reads or sets a timer and leave it count further on when they return
+typedef void (*engine_type)(chip8_type *chip8, int count);
+
+typedef void (*handler_type)(chip8_type *chip8, const instr_type *inst);
+
+//Handler for every op_type, used by the TABLE engine and called from JIT compiled blocks
+extern const handler_type handlers[];
+extern const char *const op_names[];
+
+void decode(chip8_type *chip8, uint16_t addr);
+void fuse(chip8_type *chip8, uint16_t addr);
+void invalidate(chip8_type *chip8, uint16_t addr, uint16_t len);
+int init_chip8(chip8_type *chip8, config_type *config);
+int init_chip8_program(chip8_type *chip8, const config_type *config, const uint8_t *program, size_t size);
+bool check_keypad(chip8_type *chip8, uint8_t *key_value);
+int emulate(chip8_type *chip8, int budget);
+void run_switch(chip8_type *chip8, int count);
+void run_table(chip8_type *chip8, int count);
+engine_type select_engine(chip8_type *chip8, const config_type *config);
+uint64_t timer_ticks(const chip8_type *chip8, uint64_t cycle);
+uint64_t tick_cycle(const chip8_type *chip8, uint64_t tick);
+uint8_t read_timer(const chip8_type *chip8, uint64_t expires, uint64_t cycle);
+uint64_t set_timer(const chip8_type *chip8, uint8_t value);
+#ifdef CHIP8_PROFILE
+void profile_report(const chip8_type *chip8, FILE *out);
+void profile_folded(const chip8_type *chip8, FILE *out);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
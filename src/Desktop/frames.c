@@ -0,0 +1,31 @@
+#include "frames.h"
+
+#define FRAME_FRESH 0x4 //Set on middle when it holds a frame the reader hasn't seen
+#define FRAME_SLOT  0x3
+
+void frames_init(frames_type *frames){
+    frames->back = 0;
+    atomic_init(&frames->middle, 1);
+    frames->front = 2;
+}
+
+//Slot to write the next frame into
+frame_type *frames_back(frames_type *frames){
+    return &frames->slots[frames->back];
+}
+
+//Swap the finished back slot into the middle, and carry on writing into whatever was there
+void frames_publish(frames_type *frames){
+    frames->back = atomic_exchange_explicit(&frames->middle, frames->back | FRAME_FRESH, memory_order_acq_rel) & FRAME_SLOT;
+}
+
+//Take the newest frame if there is one, returns false when front is already the latest
+bool frames_acquire(frames_type *frames){
+    if(!(atomic_load_explicit(&frames->middle, memory_order_acquire) & FRAME_FRESH)){return false;}
+    frames->front = atomic_exchange_explicit(&frames->middle, frames->front, memory_order_acq_rel) & FRAME_SLOT;
+    return true;
+}
+
+const frame_type *frames_front(const frames_type *frames){
+    return &frames->slots[frames->front];
+}
@@ -0,0 +1,31 @@
+#ifndef FRAMES_H
+#define FRAMES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+//Lock free triple buffer for handing finished frames from the emulation thread to the SDL thread.
+//The writer always has a slot to draw into and the reader always has a whole frame to show, neither
+//ever waits on the other. If the writer publishes twice before the reader looks, the older frame is dropped.
+
+typedef struct{
+    uint64_t display[64][2];
+    bool hires; //Only the top left 64x32 is showing unless this is set
+    uint64_t cycles; //Emulated time it was published at, for the frame time statistics
+} frame_type;
+
+typedef struct{
+    frame_type slots[3];
+    atomic_uint_fast8_t middle; //Slot waiting to be picked up, FRAME_FRESH is set until the reader takes it
+    uint8_t back;               //Slot the writer fills, only the emulation thread touches it
+    uint8_t front;              //Slot the reader shows, only the SDL thread touches it
+} frames_type;
+
+void frames_init(frames_type *frames);
+frame_type *frames_back(frames_type *frames);
+void frames_publish(frames_type *frames);
+bool frames_acquire(frames_type *frames);
+const frame_type *frames_front(const frames_type *frames);
+
+#endif
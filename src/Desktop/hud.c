@@ -0,0 +1,50 @@
+#include "hud.h"
+
+//Rows top to bottom, bit 2 is the left column
+static const uint8_t digits[10][5] = {
+    {7,5,5,5,7}, {2,6,2,2,7}, {7,1,7,4,7}, {7,1,7,1,7}, {5,5,7,1,1},
+    {7,4,7,1,7}, {7,4,7,5,7}, {7,1,1,1,1}, {7,5,7,5,7}, {7,5,7,1,7},
+};
+
+static const uint8_t letters[26][5] = {
+    {2,5,7,5,5}, {6,5,6,5,6}, {3,4,4,4,3}, {6,5,5,5,6}, {7,4,6,4,7}, {7,4,6,4,4}, {3,4,5,5,3},
+    {5,5,7,5,5}, {7,2,2,2,7}, {1,1,1,5,2}, {5,5,6,5,5}, {4,4,4,4,7}, {5,7,7,5,5}, {6,5,5,5,5},
+    {2,5,5,5,2}, {6,5,6,4,4}, {2,5,5,6,3}, {6,5,6,5,5}, {3,4,2,1,6}, {7,2,2,2,2}, {5,5,5,5,7},
+    {5,5,5,5,2}, {5,5,7,7,5}, {5,5,2,5,5}, {5,5,2,2,2}, {7,1,2,4,7},
+};
+
+static const uint8_t *glyph(char c){
+    static const uint8_t blank[5], dot[5] = {0,0,0,0,2}, slash[5] = {1,1,2,4,4}, colon[5] = {0,2,0,2,0},
+        percent[5] = {5,1,2,4,5}, dash[5] = {0,0,7,0,0}, open[5] = {1,2,2,2,1}, close[5] = {4,2,2,2,4};
+    if(c >= '0' && c <= '9'){return digits[c - '0'];}
+    if(c >= 'A' && c <= 'Z'){return letters[c - 'A'];}
+    if(c >= 'a' && c <= 'z'){return letters[c - 'a'];}
+    switch(c){
+        case('.'):{return dot;}
+        case('/'):{return slash;}
+        case(':'):{return colon;}
+        case('%'):{return percent;}
+        case('-'):{return dash;}
+        case('('):{return open;}
+        case(')'):{return close;}
+        default:{return blank;}
+    }
+}
+
+//Fill with bg and write each line 4 pixels a character, 6 a line, clipped to the buffer
+void hud_render(hud_type *hud, const char *const lines[HUD_LINES], uint32_t fg, uint32_t bg){
+    for(int i = 0; i < HUD_WIDTH * HUD_HEIGHT; i++){hud->pixels[i] = bg;}
+
+    for(int line = 0; line < HUD_LINES; line++){
+        const int top = 1 + line * 6;
+        for(int ch = 0; lines[line][ch] && 1 + ch * 4 + 3 <= HUD_WIDTH; ch++){
+            const uint8_t *rows = glyph(lines[line][ch]);
+            const int left = 1 + ch * 4;
+            for(int y = 0; y < 5; y++){
+                for(int x = 0; x < 3; x++){
+                    if(rows[y] & (4 >> x)){hud->pixels[(top + y) * HUD_WIDTH + left + x] = fg;}
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include <stdint.h>
+
+//Statistics overlay drawn with a 3x5 bitmap font into a small RGBA8888 buffer, which the front end
+//uploads to a texture and blends over the display. Only redrawn when the numbers change, once a second.
+
+#define HUD_WIDTH 160 //Pixels, 40 characters of 4
+#define HUD_HEIGHT 26  //4 lines of 6, plus a border
+#define HUD_LINES 4
+
+typedef struct{
+    uint32_t pixels[HUD_WIDTH * HUD_HEIGHT];
+} hud_type;
+
+void hud_render(hud_type *hud, const char *const lines[HUD_LINES], uint32_t fg, uint32_t bg);
+
+#endif
@@ -0,0 +1,394 @@
+#include "jit.h"
+
+#if defined(__linux__) && defined(__x86_64__)
+
+#include <stddef.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define JIT_CODE_SIZE (1 << 20) //Code buffer, thrown away and refilled when it runs out
+#define JIT_MAX_BLOCK 64        //Instructions per block, blocks exit early when the batch runs out so this only bounds code size
+#define JIT_INST_BYTES 48       //Most machine code any one instruction compiles to
+#define JIT_EXIT_BYTES 80       //Budget check and skip jump on an instruction, plus the side exits they go to
+#define JIT_BLOCK_BYTES (JIT_MAX_BLOCK * (JIT_INST_BYTES + JIT_EXIT_BYTES) + 32)
+#define JIT_SMC_WRITES 2        //Writes into compiled code before an address is left to the interpreter
+
+//Where each piece of chip8 state lives relative to rbx, which holds the chip8 pointer inside a block
+#define OFF_V(reg) (offsetof(chip8_type, V) + (reg))
+#define OFF_VF OFF_V(0xF)
+#define OFF_I offsetof(chip8_type, I)
+#define OFF_PC offsetof(chip8_type, pc)
+#define OFF_SP offsetof(chip8_type, sp)
+#define OFF_STACK offsetof(chip8_type, stack)
+#define OFF_KEYPAD offsetof(chip8_type, keypad)
+
+//x86 register numbers as they go in the reg field of a ModRM byte
+#define AL 0
+#define CL 1
+#define DL 2
+
+//Runs at most count instructions of the block and returns how many it ran, pc is left on the next one
+typedef int (*block_fn)(chip8_type *chip8, int count);
+
+typedef struct{
+    block_fn code; //NULL if the instruction at this pc has to be interpreted
+    bool seen;     //Compile has been tried for this pc since the last flush
+} jit_block;
+
+struct jit{
+    uint8_t *buf;            //Code, read and execute only except while compile() is writing a block (W^X)
+    size_t used;
+    size_t page;
+    jit_block blocks[4096];  //Indexed by start pc
+    bool covered[4096];      //Ram bytes some compiled block was built from
+    uint8_t writes[4096];    //Times a write hit compiled code at this byte, survives flushes
+};
+
+//What compile_inst() did with an instruction
+typedef enum{
+    INST_NEXT, //Compiled, carry on with the next one
+    INST_JUMP, //Compiled, carry on at trace->next. pc in memory is stale until the block leaves
+    INST_SKIP, //Compiled, the jump at trace->skip leaves the block when the skip is taken, otherwise carry on with the next one
+    INST_END,  //Compiled, and it already set pc so the block ends here
+    INST_STOP, //Left for emulate(), the block ends before it
+} inst_result;
+
+//The path a block follows, blocks run on through skips, jumps and calls wherever the next pc is known
+typedef struct{
+    uint16_t next;                   //Where an INST_JUMP goes
+    uint8_t *skip;                   //rel32 of an INST_SKIP's jump, patched to its side exit
+    uint16_t returns[JIT_MAX_BLOCK]; //Return addresses of the 2NNNs followed so far, innermost last
+    int depth;
+} trace_type;
+
+static void emit8(uint8_t **p, uint8_t v){*(*p)++ = v;}
+static void emit16(uint8_t **p, uint16_t v){memcpy(*p, &v, 2); *p += 2;}
+static void emit32(uint8_t **p, uint32_t v){memcpy(*p, &v, 4); *p += 4;}
+static void emit64(uint8_t **p, uint64_t v){memcpy(*p, &v, 8); *p += 8;}
+
+//opcode reg, [rbx + disp32]
+static void mem_op(uint8_t **p, uint8_t opcode, uint8_t reg, size_t disp){
+    emit8(p, opcode);
+    emit8(p, 0x80 | reg << 3 | 3);
+    emit32(p, (uint32_t)disp);
+}
+static void load8(uint8_t **p, uint8_t reg, size_t disp){mem_op(p, 0x8A, reg, disp);}   //mov reg8, [rbx+disp]
+static void store8(uint8_t **p, uint8_t reg, size_t disp){mem_op(p, 0x88, reg, disp);}  //mov [rbx+disp], reg8
+static void store_pc(uint8_t **p, uint16_t pc){emit8(p, 0x66); mem_op(p, 0xC7, 0, OFF_PC); emit16(p, pc);} //mov word [pc], imm16
+
+//Return ran from the block, undoing the prologue in compile()
+static void leave_block(uint8_t **p, int ran){
+    emit8(p, 0xB8); emit32(p, (uint32_t)ran);                   //mov eax, ran
+    emit8(p, 0x48); emit8(p, 0x83); emit8(p, 0xC4); emit8(p, 0x08); //add rsp, 8
+    emit8(p, 0x41); emit8(p, 0x5C);                             //pop r12
+    emit8(p, 0x5B);                                             //pop rbx
+    emit8(p, 0xC3);                                             //ret
+}
+
+//Call the interpreter's handler for the instruction at addr, for the ops not worth compiling
+static void call_handler(uint8_t **p, chip8_type *chip8, uint16_t addr){
+    emit8(p, 0x48); emit8(p, 0x89); emit8(p, 0xDF);                                  //mov rdi, rbx
+    emit8(p, 0x48); emit8(p, 0xBE); emit64(p, (uint64_t)(uintptr_t)&chip8->cache[addr]); //mov rsi, inst
+    emit8(p, 0x48); emit8(p, 0xB8); emit64(p, (uint64_t)(uintptr_t)handlers[chip8->cache[addr].base_op]); //mov rax, handler
+    emit8(p, 0xFF); emit8(p, 0xD0);                                                  //call rax
+}
+
+//Flags are already set by a compare, jcc out of the block when the skip is taken. compile() points it at the side exit
+static inst_result skip(uint8_t **p, uint8_t jcc, trace_type *trace){
+    emit8(p, 0x0F); emit8(p, jcc); //jcc rel32
+    trace->skip = *p;
+    emit32(p, 0);
+    return INST_SKIP;
+}
+
+//Same ops in the same order as the handlers, VX/VY are reloaded after every write so X or Y being F behaves the same
+static inst_result compile_inst(uint8_t **p, chip8_type *chip8, uint16_t addr, trace_type *trace){
+    const instr_type *inst = &chip8->cache[addr];
+    const uint8_t X = inst->X;
+    const uint8_t Y = inst->Y;
+
+    switch(inst->base_op){ //Blocks already run straight through, fused pairs would only get in the way
+        case(OP_NOP):{return INST_NEXT;}
+        case(OP_6XNN):{mem_op(p, 0xC6, 0, OFF_V(X)); emit8(p, inst->NN); return INST_NEXT;}
+        case(OP_7XNN):{mem_op(p, 0x80, 0, OFF_V(X)); emit8(p, inst->NN); return INST_NEXT;}
+        case(OP_8XY0):{load8(p, AL, OFF_V(Y)); store8(p, AL, OFF_V(X)); return INST_NEXT;}
+        case(OP_8XY1):{load8(p, AL, OFF_V(X)); mem_op(p, 0x0A, AL, OFF_V(Y)); store8(p, AL, OFF_V(X)); return INST_NEXT;}
+        case(OP_8XY2):{load8(p, AL, OFF_V(X)); mem_op(p, 0x22, AL, OFF_V(Y)); store8(p, AL, OFF_V(X)); return INST_NEXT;}
+        case(OP_8XY3):{load8(p, AL, OFF_V(X)); mem_op(p, 0x32, AL, OFF_V(Y)); store8(p, AL, OFF_V(X)); return INST_NEXT;}
+        case(OP_8XY4):{
+            load8(p, AL, OFF_V(X));
+            mem_op(p, 0x02, AL, OFF_V(Y));               //add al, VY
+            emit8(p, 0x0F); emit8(p, 0x92); emit8(p, 0xC1); //setc cl
+            store8(p, CL, OFF_VF);
+            store8(p, AL, OFF_V(X));
+            return INST_NEXT;
+        }
+        case(OP_8XY5):{
+            load8(p, AL, OFF_V(X));
+            mem_op(p, 0x2A, AL, OFF_V(Y));               //sub al, VY
+            store8(p, AL, OFF_V(X));
+            load8(p, AL, OFF_V(X));
+            mem_op(p, 0x3A, AL, OFF_V(Y));               //cmp al, VY
+            emit8(p, 0x0F); emit8(p, 0x93); emit8(p, 0xC1); //setae cl
+            store8(p, CL, OFF_VF);
+            return INST_NEXT;
+        }
+        case(OP_8XY7):{
+            load8(p, AL, OFF_V(Y));
+            mem_op(p, 0x2A, AL, OFF_V(X));
+            store8(p, AL, OFF_V(X));
+            load8(p, AL, OFF_V(Y));
+            mem_op(p, 0x3A, AL, OFF_V(X));
+            emit8(p, 0x0F); emit8(p, 0x93); emit8(p, 0xC1);
+            store8(p, CL, OFF_VF);
+            return INST_NEXT;
+        }
+        case(OP_8XY6):
+        case(OP_8XY6_VY):{
+            const uint8_t src = (inst->base_op == OP_8XY6_VY) ? Y : X;
+            load8(p, AL, OFF_V(src));
+            emit8(p, 0x24); emit8(p, 0x01);               //and al, 1
+            store8(p, AL, OFF_VF);
+            load8(p, AL, OFF_V(src));
+            emit8(p, 0xD0); emit8(p, 0xE8);               //shr al, 1
+            store8(p, AL, OFF_V(X));
+            return INST_NEXT;
+        }
+        case(OP_8XYE):
+        case(OP_8XYE_VY):{
+            const uint8_t src = (inst->base_op == OP_8XYE_VY) ? Y : X;
+            load8(p, AL, OFF_V(src));
+            emit8(p, 0xC0); emit8(p, 0xE8); emit8(p, 0x07); //shr al, 7
+            store8(p, AL, OFF_VF);
+            load8(p, AL, OFF_V(src));
+            emit8(p, 0x00); emit8(p, 0xC0);               //add al, al
+            store8(p, AL, OFF_V(X));
+            return INST_NEXT;
+        }
+        case(OP_ANNN):{emit8(p, 0x66); mem_op(p, 0xC7, 0, OFF_I); emit16(p, inst->NNN); return INST_NEXT;}
+        case(OP_FX1E):{
+            emit8(p, 0x0F); mem_op(p, 0xB6, AL, OFF_V(X)); //movzx eax, VX
+            emit8(p, 0x66); mem_op(p, 0x01, AL, OFF_I);    //add [I], ax
+            return INST_NEXT;
+        }
+        case(OP_FX1E_VF):{
+            emit8(p, 0x0F); mem_op(p, 0xB7, AL, OFF_I);    //movzx eax, I
+            emit8(p, 0x0F); mem_op(p, 0xB6, CL, OFF_V(X)); //movzx ecx, VX
+            emit8(p, 0x01); emit8(p, 0xC8);                //add eax, ecx
+            emit8(p, 0x3D); emit32(p, 0xFFF);              //cmp eax, 0xFFF
+            emit8(p, 0x0F); emit8(p, 0x97); emit8(p, 0xC2); //seta dl
+            store8(p, DL, OFF_VF);
+            emit8(p, 0x66); mem_op(p, 0x89, AL, OFF_I);    //mov [I], ax
+            return INST_NEXT;
+        }
+        case(OP_FX29):{
+            emit8(p, 0x0F); mem_op(p, 0xB6, AL, OFF_V(X)); //movzx eax, VX
+            emit8(p, 0x8D); emit8(p, 0x04); emit8(p, 0x80); //lea eax, [rax + rax*4]
+            emit8(p, 0x66); mem_op(p, 0x89, AL, OFF_I);    //mov [I], ax
+            return INST_NEXT;
+        }
+
+        //Rare or too big to be worth compiling, and none of them look at pc
+        case(OP_00E0):
+        case(OP_CXNN):
+        case(OP_FX65):
+        case(OP_FX65_I):
+        case(OP_F002):
+        case(OP_FX3A):
+        case(OP_00CN):
+        case(OP_00FB):
+        case(OP_00FC):
+        case(OP_00FE):
+        case(OP_00FF):
+        case(OP_FX30):
+        case(OP_FX75):
+        case(OP_FX85):{call_handler(p, chip8, addr); return INST_NEXT;}
+
+        //Timers are worked out from chip8->cycles, which is only right at the start of a block, see compile()
+        case(OP_FX07):
+        case(OP_FX15):
+        case(OP_FX18):{call_handler(p, chip8, addr); return INST_NEXT;}
+
+        //Only forward, a loop unrolled into every block that enters it part way round would be copied over and over
+        case(OP_1NNN):{
+            if(inst->NNN <= addr){store_pc(p, inst->NNN); return INST_END;}
+            trace->next = inst->NNN;
+            return INST_JUMP;
+        }
+        case(OP_3XNN):{load8(p, AL, OFF_V(X)); emit8(p, 0x3C); emit8(p, inst->NN); return skip(p, 0x84, trace);} //cmp al, NN; je
+        case(OP_4XNN):{load8(p, AL, OFF_V(X)); emit8(p, 0x3C); emit8(p, inst->NN); return skip(p, 0x85, trace);} //jne
+        case(OP_5XY0):{load8(p, AL, OFF_V(X)); mem_op(p, 0x3A, AL, OFF_V(Y)); return skip(p, 0x84, trace);}
+        case(OP_9XY0):{load8(p, AL, OFF_V(X)); mem_op(p, 0x3A, AL, OFF_V(Y)); return skip(p, 0x85, trace);}
+
+        //keypad[VX] with VX unmasked, the same read the handler does
+        case(OP_EX9E):
+        case(OP_EXA1):{
+            emit8(p, 0x0F); mem_op(p, 0xB6, 0, OFF_V(X));                       //movzx eax, byte [VX]
+            emit8(p, 0x80); emit8(p, 0xBC); emit8(p, 0x03); emit32(p, OFF_KEYPAD); emit8(p, 0); //cmp byte [rbx + rax + keypad], 0
+            return skip(p, inst->base_op == OP_EX9E ? 0x85 : 0x84, trace);      //jne, je
+        }
+
+        //Calls carry on into the subroutine, and a return to a call this block made carries on after it
+        case(OP_2NNN):{
+            emit8(p, 0x0F); mem_op(p, 0xB6, 0, OFF_SP);                           //movzx eax, byte [sp]
+            emit8(p, 0x66); emit8(p, 0xC7); emit8(p, 0x84); emit8(p, 0x43); emit32(p, OFF_STACK); emit16(p, addr + 2); //mov word [rbx + rax*2 + stack], addr + 2
+            mem_op(p, 0xFE, 0, OFF_SP);                                           //inc byte [sp]
+            trace->next = inst->NNN;
+            trace->returns[trace->depth++] = addr + 2; //Never more calls than instructions in the block
+            return INST_JUMP;
+        }
+        case(OP_00EE):{
+            if(trace->depth == 0){call_handler(p, chip8, addr); return INST_END;}
+            mem_op(p, 0xFE, 1, OFF_SP); //dec byte [sp]
+            trace->next = trace->returns[--trace->depth]; //Nothing a block runs touches the stack, so this is what gets popped
+            return INST_JUMP;
+        }
+
+        //Let the handler work out where pc goes
+        case(OP_BNNN):
+        case(OP_BXNN):{store_pc(p, addr + 2); call_handler(p, chip8, addr); return INST_END;}
+
+        //DXYN, DXY0, 00FD and FX0A stay in the interpreter, FX33/FX55 write ram and may rewrite the block they are in
+        default:{return INST_STOP;}
+    }
+}
+
+//Ops that read or set a timer, they only ever come first in a block
+static bool uses_timers(uint8_t op){
+    return op == OP_FX07 || op == OP_FX15 || op == OP_FX18;
+}
+
+static void flush(struct jit *jit){
+    memset(jit->blocks, 0, sizeof jit->blocks);
+    memset(jit->covered, false, sizeof jit->covered);
+    jit->used = 0;
+}
+
+//Make the pages the next block goes in writable, or executable again once it is written
+static void protect(struct jit *jit, uint8_t *code, int prot){
+    const uintptr_t first = (uintptr_t)code & ~(jit->page - 1);
+    const uintptr_t end = ((uintptr_t)code + JIT_BLOCK_BYTES + jit->page - 1) & ~(jit->page - 1);
+    mprotect((void *)first, end - first, prot);
+}
+
+static void compile(struct jit *jit, chip8_type *chip8, uint16_t start){
+    if(jit->used + JIT_BLOCK_BYTES > JIT_CODE_SIZE){flush(jit);}
+
+    jit_block *block = &jit->blocks[start];
+    uint8_t *const code = jit->buf + jit->used;
+    uint8_t *p = code;
+    uint16_t addr = start;
+    int len = 0;
+    inst_result result = INST_STOP;
+    trace_type trace = {.depth = 0};
+    struct exit_patch{uint8_t *rel; uint16_t pc; int ran;} exits[2 * JIT_MAX_BLOCK]; //Jumps waiting for their side exit
+    int exit_count = 0;
+
+    protect(jit, code, PROT_READ | PROT_WRITE);
+    emit8(&p, 0x53);                                   //push rbx
+    emit8(&p, 0x41); emit8(&p, 0x54);                  //push r12
+    emit8(&p, 0x48); emit8(&p, 0x83); emit8(&p, 0xEC); emit8(&p, 0x08); //sub rsp, 8, keeps the handler calls 16 byte aligned
+    emit8(&p, 0x48); emit8(&p, 0x89); emit8(&p, 0xFB); //mov rbx, rdi
+    emit8(&p, 0x41); emit8(&p, 0x89); emit8(&p, 0xF4); //mov r12d, esi, the count survives handler calls in r12
+
+    while(len < JIT_MAX_BLOCK){
+        if(addr > 0xFFE || jit->writes[addr] >= JIT_SMC_WRITES || jit->writes[addr + 1] >= JIT_SMC_WRITES){result = INST_STOP; break;}
+        if(len > 0 && uses_timers(chip8->cache[addr].base_op)){result = INST_STOP; break;} //Starts the next block instead
+        if(len > 0 && chip8->cache[addr].op >= OP_IDLE_1NNN){result = INST_STOP; break;} //So run_jit() can skip the idle loop
+        uint8_t *const check = p;
+        const int checks = exit_count;
+        if(len > 0){
+            //Batch ends before this instruction, leave with pc on it. The first one always has budget
+            emit8(&p, 0x41); emit8(&p, 0x83); emit8(&p, 0xFC); emit8(&p, (uint8_t)len); //cmp r12d, len
+            emit8(&p, 0x0F); emit8(&p, 0x8E); emit32(&p, 0);                          //jle exit, patched below
+            exits[exit_count++] = (struct exit_patch){p - 4, addr, len};
+        }
+        result = compile_inst(&p, chip8, addr, &trace);
+        if(result == INST_STOP){p = check; exit_count = checks; break;}
+        jit->covered[addr] = jit->covered[addr + 1] = true;
+        len++;
+        if(result == INST_SKIP){exits[exit_count++] = (struct exit_patch){trace.skip, addr + 4, len};}
+        if(result == INST_END){break;}
+        addr = (result == INST_JUMP) ? trace.next : addr + 2;
+    }
+
+    block->seen = true;
+    if(len == 0){protect(jit, code, PROT_READ | PROT_EXEC); return;} //Nothing compiled, emulate() gets this pc every time until the next flush
+
+    if(result != INST_END){store_pc(&p, addr);} //Fell off the end, carry on from the instruction after the block
+    leave_block(&p, len);
+
+    //Side exits out of line, so the path that runs the whole block falls straight through every check
+    for(int i = 0; i < exit_count; i++){
+        const int32_t rel = (int32_t)(p - (exits[i].rel + 4));
+        memcpy(exits[i].rel, &rel, 4);
+        store_pc(&p, exits[i].pc);
+        leave_block(&p, exits[i].ran);
+    }
+    protect(jit, code, PROT_READ | PROT_EXEC);
+
+    block->code = (block_fn)(void *)code;
+    jit->used += p - code;
+}
+
+struct jit *jit_create(void){
+    struct jit *jit = calloc(1, sizeof(struct jit));
+    if(!jit){return NULL;}
+
+    //Never writable and executable at once, compile() opens up only the pages it is writing
+    jit->buf = mmap(NULL, JIT_CODE_SIZE, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(jit->buf == MAP_FAILED){free(jit); return NULL;}
+    jit->page = (size_t)sysconf(_SC_PAGESIZE);
+
+    return jit;
+}
+
+void jit_destroy(struct jit *jit){
+    if(!jit){return;}
+    munmap(jit->buf, JIT_CODE_SIZE);
+    free(jit);
+}
+
+//addr to addr+len-1 was written, throw every block away if any of them was built from those bytes
+void jit_invalidate(struct jit *jit, uint16_t addr, uint16_t len){
+    bool hit = false;
+    for(uint16_t i = 0; i < len; i++){
+        const uint16_t byte = (addr + i) & 0x0FFF;
+        if(jit->covered[byte]){
+            hit = true;
+            if(jit->writes[byte] < JIT_SMC_WRITES){jit->writes[byte]++;}
+        }
+    }
+    if(hit){flush(jit);}
+}
+
+void run_jit(chip8_type *chip8, int count){
+    struct jit *jit = chip8->jit;
+
+    while(count > 0){
+        const uint16_t pc = chip8->pc;
+        if(chip8->cache[pc & 0x0FFF].op >= OP_IDLE_1NNN){count -= emulate(chip8, count); continue;} //Idle loop, skip to the end of the batch
+        if(pc <= 0xFFE){
+            const jit_block *block = &jit->blocks[pc];
+            if(!block->seen){compile(jit, chip8, pc);}
+            //Blocks check the budget themselves and stop where the batch ends, so the count stays exact
+            if(block->code){
+                const int ran = block->code(chip8, count);
+                chip8->cycles += ran;
+                count -= ran;
+                continue;
+            }
+        }
+        emulate(chip8, 1);
+        count--;
+    }
+}
+
+#else
+
+struct jit *jit_create(void){return NULL;}
+void jit_destroy(struct jit *jit){(void)jit;}
+void jit_invalidate(struct jit *jit, uint16_t addr, uint16_t len){(void)jit; (void)addr; (void)len;}
+void run_jit(chip8_type *chip8, int count){run_switch(chip8, count);}
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "chip8.h"
+
+//Block recompiler for Linux x86-64. A block is compiled once and cached by its start address, and follows
+//the code on through skips (taken ones leave the block), forward jumps, calls and returns to its own calls,
+//up to a backward jump, a computed jump or a return it can't see the call for. Blocks leave early when the
+//batch runs out, so they never run past the instruction count they were given. DXYN, FX0A and anything
+//that writes ram (FX33/FX55) always go through emulate(), as do addresses a ROM keeps rewriting.
+//On every other platform jit_create() returns NULL and select_engine() falls back to the interpreter.
+
+struct jit;
+
+struct jit *jit_create(void);
+void jit_destroy(struct jit *jit);
+void jit_invalidate(struct jit *jit, uint16_t addr, uint16_t len);
+void run_jit(chip8_type *chip8, int count);
+
+#endif
@@ -1,13 +1,29 @@
 #define SDL_MAIN_HANDLED
 
 #include <stdio.h>
+#ifdef _WIN32
 #include "D:\SDL2-2.28.4\include\SDL.h"
+#include <windows.h>
+#else
+#include <SDL2/SDL.h>
+#endif
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
-#include <windows.h>
 #include <string.h>
 #include <time.h>
+#include <stdatomic.h>
+#include "chip8.h"
+#include "jit.h"
+#include "frames.h"
+#include "sched.h"
+#include "state.h"
+#include "rewind.h"
+#include "movie.h"
+#include "trace.h"
+#include "stats.h"
+#include "hud.h"
+#include "audio.h"
 
 
 
@@ -29,70 +45,72 @@ size_t strlcpy(char *dest, const char *src, size_t size) {
 typedef struct {
     SDL_Window *window;
     SDL_Renderer *renderer;
+    SDL_Texture *texture; //128x64 copy of the display, SDL scales the part that's showing up to the window in one copy
+    SDL_Texture *hud; //Statistics overlay, blended over the top left of the display when show_hud is set
+    bool show_hud;
+    bool redraw; //Window needs presenting again even though there is no new frame
+    bool upload; //Texture was recreated blank, the front frame has to go up again even though it isn't new
     SDL_AudioSpec want, have;
-    SDL_AudioDeviceID device;
+    SDL_AudioDeviceID device; //0 if audio didn't open, the emulator still runs silent
 } sdl_type;
 //Create a struct that holds our pointer to a window (More OOP approach)
 
+//Hotkeys that need chip8, the SDL thread asks and the emulation thread does it between frames
 typedef enum{
-    COSMAC,
-    AMIGA, 
-}emu_type;
-
-
-//Config Object
-typedef struct {
-    emu_type choice;
-    uint32_t bg_colour;
-    uint32_t fg_colour;
-    int res_x;
-    int res_y;
-    char rom_name[50];
-    int insts_per_sec;
-    int sf;
-} config_type;
-
-
-//Enum for emulation state
-typedef enum{
-    QUIT,
-    RUNNING,
-    PAUSED,
-} emu_state;
-
-typedef union{
-    uint16_t full_op;
-    uint8_t data[2];
-} opcode_t;
-
+    CMD_NONE,
+    CMD_SAVE,
+    CMD_LOAD,
+    CMD_PROFILE,
+} state_command;
+
+//Everything the SDL thread and the emulation thread share. Filled in before the thread starts,
+//after that only the atomics, the frame buffer and each thread's own half of stats are touched from both sides
 typedef struct{
-    opcode_t opcode;
-    uint16_t NNN;   //Constants in instruction set, declaring like this would decrease space complexity
-    uint8_t NN;     
-    uint8_t N;      
-    uint8_t X;      
-    uint8_t Y;      
-} instr_type;
-
-//Chip 8 object
-typedef struct{
-    emu_state state;
-    uint8_t ram[4096]; //Ram for the chip 8
-    bool display[64*32]; //Decided to have seperate arrays for display instead of a pointer to ram. May change if I move onto super chip
-    uint16_t stack[48]; 
-    uint16_t *stkptr;
-    uint8_t V[16]; //Registers from V0-Vf
-    uint16_t I; //Index Register  
-    uint16_t pc;
-    uint8_t delay_timer;
-    uint8_t sound_timer; //60Hz timers in chip 8
-    bool keypad[16]; //Check if keypad is in off or on state
-    const char *rom_name; // Get a command line dir for rom to load into ram
-    instr_type inst;
-    bool draw;
-} chip8_type;
+    chip8_type *chip8;
+    engine_type engine;
+    int insts_per_sec;
+    frames_type frames;
+    atomic_int state;  //emu_state, set by the SDL thread from input
+    atomic_uint keys;  //Bit per keypad key, set by the SDL thread from input
+    atomic_int measured_ips;     //Set by the emulation thread about once a second
+    atomic_int measured_fps_x10;
+    atomic_int command; //state_command, set by the SDL thread from input
+    char state_path[64]; //Where F5 saves to and F9 loads from
+    atomic_bool rewinding; //Backspace held, set by the SDL thread from input
+    int rewind_seconds;
+    movie_type movie; //Recording keypad changes when movie.file is open, only the emulation thread touches it
+    trace_type *trace; //Frame phase trace, NULL unless --trace was given
+    atomic_uint_fast64_t key_event; //Counter value of a keypad change no batch has seen yet, 0 if none
+    audio_type audio; //Beeper the emulation thread posts the sound timer to and the audio callback plays
+
+    stats_type stats; //Frame times are filled in by the SDL thread as it presents, the rest by the emulation thread
+
+    //Last second of lateness and input statistics for the HUD, set by the emulation thread
+    atomic_int late, dropped;
+    atomic_int latency_mean_us, latency_max_us; //-1 with no key presses in the window
+} shared_type;
+
+//Threads that trace, one ring each
+enum{TRACE_SDL, TRACE_EMU};
+
+//Counter a traced phase starts at, tracing off skips the read
+static inline uint64_t phase_start(const shared_type *shared){return shared->trace ? SDL_GetPerformanceCounter() : 0;}
+
+static inline void phase_end(shared_type *shared, int thread, const char *name, uint64_t begin){
+    if(shared->trace){trace_push(&shared->trace->rings[thread], name, begin, SDL_GetPerformanceCounter());}
+}
 
+//Texture belongs to the renderer, so this has to run again whenever the renderer is recreated
+int create_texture(sdl_type *sdl){
+    //RGBA8888 packs a pixel the same way as bg_colour/fg_colour in the config, so they can be written as is
+    sdl->texture = SDL_CreateTexture(sdl->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, 128, 64); //Big enough for SUPER-CHIP hi-res
+    if(!sdl->texture){SDL_Log("Could not create Texture %s\n", SDL_GetError()); return 0;}
 
+    sdl->hud = SDL_CreateTexture(sdl->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STATIC, HUD_WIDTH, HUD_HEIGHT);
+    if(!sdl->hud){SDL_Log("Could not create HUD Texture %s\n", SDL_GetError()); return 0;}
+    SDL_SetTextureBlendMode(sdl->hud, SDL_BLENDMODE_BLEND);
+    return 1;
+}
 
 //Initialiser for sdl object 
 int init_sdl(sdl_type *sdl, config_type *config){
@@ -115,17 +133,40 @@ int init_sdl(sdl_type *sdl, config_type *config){
     sdl->renderer = SDL_CreateRenderer(
         sdl->window,
         -1,
-        SDL_RENDERER_ACCELERATED
+        SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC
     ); //Creates Renderer using our pointer with said Parameters 
 
     if(!sdl->renderer){SDL_Log("Could not create Renderer %s\n", SDL_GetError()); return 0;} //If renderer can't initialise throw error
 
+    if(!create_texture(sdl)){return 0;}
 
 
 
     return 1; // Success
 }
 
+//Opens the beeper, running without sound if there is no audio device
+void init_audio(sdl_type *sdl, const config_type *config, audio_type *audio){
+    const int samples = audio_samples(config->audio_samples > 0 ? config->audio_samples : 256, AUDIO_RATE);
+    if(samples < config->audio_samples){SDL_Log("audio_samples %d is over %dms, using %d", config->audio_samples, AUDIO_MAX_LATENCY_MS, samples);}
+
+    sdl->want = (SDL_AudioSpec){
+        .freq = AUDIO_RATE,
+        .format = AUDIO_S16SYS,
+        .channels = 1,
+        .samples = (Uint16)samples,
+        .callback = audio_callback,
+        .userdata = audio,
+    };
+    sdl->device = SDL_OpenAudioDevice(NULL, 0, &sdl->want, &sdl->have, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    if(!sdl->device){SDL_Log("Could not open audio device %s, running without sound\n", SDL_GetError()); return;}
+
+    audio_init(audio, sdl->have.freq, config->volume);
+    const int latency_ms = sdl->have.samples * 1000 / sdl->have.freq;
+    if(latency_ms > AUDIO_MAX_LATENCY_MS){SDL_Log("Audio device gave a %d sample buffer, %dms of latency", sdl->have.samples, latency_ms);}
+    SDL_PauseAudioDevice(sdl->device, 0); //Plays silence until the sound timer runs
+}
+
 void fileparser(char *line , char* key, char* value){
    // Make copies of the original strings for modification
     char key_copy[50];
@@ -172,71 +213,30 @@ void read_in_config(config_type *config){
         else if(!strncmp(key, "emulator_type", 14)){config->choice = atoi(value);}
         else if(!strncmp(key, "insts_per_second", 17)){config->insts_per_sec = atoi(value);}
         else if(!strncmp(key, "scale_factor", 13)){config->sf = atoi(value);}
+        else if(!strncmp(key, "dispatch", 8)){config->dispatch = atoi(value);}
+        else if(!strncmp(key, "seed", 4)){config->seed = (uint32_t)strtoul(value, NULL, 0);}
+        else if(!strncmp(key, "rewind_seconds", 14)){config->rewind_seconds = atoi(value);}
+        else if(!strncmp(key, "audio_samples", 13)){config->audio_samples = atoi(value);}
+        else if(!strncmp(key, "volume", 6)){config->volume = atoi(value);}
         else{SDL_Log("Please Check config and readme files for correct configurations");}
         }
     
+    if(config->choice > XOCHIP){SDL_Log("Unknown emulator_type %d, using COSMAC", config->choice); config->choice = COSMAC;}
+    
     
 
     fclose(config_f);
 }
 
 void end(sdl_type *sdl){
+    if(sdl->device){SDL_CloseAudioDevice(sdl->device);} //Stops the callback before the audio_type it reads goes away
+    SDL_DestroyTexture(sdl->texture); // Destroys the Texture
+    SDL_DestroyTexture(sdl->hud);
     SDL_DestroyRenderer(sdl->renderer); // Destroys the Renderer
     SDL_DestroyWindow(sdl->window); // Destroys the window
     SDL_Quit(); //Shutsdown SDL
 }
 
-int init_chip8(chip8_type *chip8, config_type *config){
-    const uint32_t entry = 0x200; //Entry point for roms to be loaded into memory
-    const uint8_t font[] = {
-        0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-        0x20, 0x60, 0x20, 0x20, 0x70, // 1
-        0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-        0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-        0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-        0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-        0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-        0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-        0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-        0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-        0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-        0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-        0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-        0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-        0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-        0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-    }; //Fonts used by the CHIP 8
-
-
-    memset(chip8, 0, sizeof(chip8_type));
-
-    //Load Font
-    memcpy(chip8->ram, font, sizeof(font));
-
-
-    //Open/Load ROM
-    FILE *rom = fopen(config->rom_name, "rb"); // Set File object to read bytes as the file is raw
-    if(!rom){SDL_Log("ROM file %s is invalid or does not exist\n" ,config->rom_name); return 0;} //Return error if file cannot be opened
-
-    fseek(rom, SEEK_SET, SEEK_END); // Set the cursor of the file from start to end
-    const size_t rom_size = ftell(rom); // Using cursor, determines rom size
-    const size_t max_size = sizeof chip8->ram - entry; // Maximum size of memory that can be allocated to programs as the from 0x0 - 0x200 is not available
-    rewind(rom); //Rewind the cursor to read later
-    if(rom_size > max_size){SDL_Log("ROM size is too big, Max size: %zu, ROM size: %zu" , max_size, rom_size); return 0;} // Return error if file size is too big 
-
-    fread(&chip8->ram[entry], rom_size, 1, rom);
-
-    fclose(rom); //Close rom file 
-
-
-    chip8->pc = entry;
-    chip8->state = RUNNING;
-    chip8->rom_name = config->rom_name;
-    chip8->stkptr = &chip8->stack[0];
-
-    return 1; //Success
-}
-
 void clear_screen(sdl_type *sdl, config_type *config){
     const uint8_t r  = (config->bg_colour >> 24) & 0xFF; //Convert our background from 32 bit to 8 so each can be read as a seperate rgb value
     const uint8_t g  = (config->bg_colour >> 16) & 0xFF;
@@ -250,79 +250,123 @@ void clear_screen(sdl_type *sdl, config_type *config){
 
 
 
-void user_input(chip8_type *chip8, sdl_type *sdl, config_type *config){
+//Redraw the overlay from the last second of statistics, frame times from this thread's presents and the rest from the emulation thread
+void update_hud(sdl_type *sdl, shared_type *shared, const config_type *config){
+    static hud_type hud;
+    char lines[HUD_LINES][48];
+    const int fps_x10 = shared->measured_fps_x10;
+    const int latency_mean = shared->latency_mean_us, latency_max = shared->latency_max_us;
+    const histogram_type *frames = &shared->stats.window_frames;
+
+    snprintf(lines[0], sizeof lines[0], "IPS %d/%d FPS %d.%d/60", (int)shared->measured_ips, shared->insts_per_sec, fps_x10 / 10, fps_x10 % 10);
+    snprintf(lines[1], sizeof lines[1], "FRAME MS P50 %.1f P95 %.1f P99 %.1f", histogram_percentile(frames, 50) / 1000.0,
+        histogram_percentile(frames, 95) / 1000.0, histogram_percentile(frames, 99) / 1000.0);
+    snprintf(lines[2], sizeof lines[2], "LATE %d DROPPED %d", (int)shared->late, (int)shared->dropped);
+    if(latency_mean < 0){snprintf(lines[3], sizeof lines[3], "INPUT MS -");}
+    else{snprintf(lines[3], sizeof lines[3], "INPUT MS MEAN %.1f MAX %.1f", latency_mean / 1000.0, latency_max / 1000.0);}
+
+    const char *const text[HUD_LINES] = {lines[0], lines[1], lines[2], lines[3]};
+    hud_render(&hud, text, config->fg_colour, 0x000000C0); //Black, three quarters opaque
+    SDL_UpdateTexture(sdl->hud, NULL, hud.pixels, HUD_WIDTH * sizeof(uint32_t));
+    sdl->redraw = true;
+}
+
+//Stamp a keypad change for the latency statistics. SDL timestamps are milliseconds since init, so the
+//event's age is taken off the counter. Only one is measured at a time, the first since the last batch
+void note_key(shared_type *shared, uint32_t timestamp){
+    const uint64_t age = (uint64_t)(SDL_GetTicks() - timestamp) * SDL_GetPerformanceFrequency() / 1000;
+    uint_fast64_t none = 0;
+    atomic_compare_exchange_strong(&shared->key_event, &none, SDL_GetPerformanceCounter() - age);
+}
+
+void user_input(shared_type *shared, sdl_type *sdl, config_type *config){
     SDL_Event event;
 
     while(SDL_PollEvent(&event)){
+        const unsigned int keys = shared->keys;
         switch(event.type){
-        case SDL_QUIT:{chip8->state = QUIT; break;} 
+        case SDL_QUIT:{shared->state = QUIT; break;} 
         case SDL_KEYDOWN:{
             switch(event.key.keysym.sym){
-                case SDLK_ESCAPE:{SDL_Log("CHIP 8 is no longer running");chip8->state = QUIT; break;} // Used keycode so the chip 8 emualtor won't be platform specific
+                case SDLK_ESCAPE:{SDL_Log("CHIP 8 is no longer running");shared->state = QUIT; break;} // Used keycode so the chip 8 emualtor won't be platform specific
                 case SDLK_p:{
-                    if(chip8->state == RUNNING){chip8->state = PAUSED; SDL_Log("CHIP 8 is now paused");}
-                    else{chip8->state = RUNNING; SDL_Log("CHIP 8 is now running");} 
+                    if(shared->state == RUNNING){shared->state = PAUSED; SDL_Log("CHIP 8 is now paused");}
+                    else{shared->state = RUNNING; SDL_Log("CHIP 8 is now running");} 
+                    break;
+                }
+                case SDLK_F5:{shared->command = CMD_SAVE; break;}
+                case SDLK_F9:{shared->command = CMD_LOAD; break;}
+                case SDLK_F3:{shared->command = CMD_PROFILE; break;}
+                case SDLK_F1:{
+                    sdl->show_hud = !sdl->show_hud;
+                    if(sdl->show_hud){update_hud(sdl, shared, config);}
+                    sdl->redraw = true;
                     break;
                 }
-                case SDLK_1:{chip8->keypad[0x1] =true; break;} //Handling Inputs 
-                case SDLK_2:{chip8->keypad[0x2] =true; break;}
-                case SDLK_3:{chip8->keypad[0x3] =true; break;}
-                case SDLK_4:{chip8->keypad[0xC] =true; break;}
-
-                case SDLK_q:{chip8->keypad[0x4] =true; break;}
-                case SDLK_w:{chip8->keypad[0x5] =true; break;}
-                case SDLK_e:{chip8->keypad[0x6] =true; break;}
-                case SDLK_r:{chip8->keypad[0xD] =true; break;}
-
-                case SDLK_a:{chip8->keypad[0x7] =true; break;}
-                case SDLK_s:{chip8->keypad[0x8] =true; break;}
-                case SDLK_d:{chip8->keypad[0x9] =true; break;}
-                case SDLK_f:{chip8->keypad[0xE] =true; break;}
-
-                case SDLK_z:{chip8->keypad[0xA] =true; break;}
-                case SDLK_x:{chip8->keypad[0x0] =true; break;}
-                case SDLK_c:{chip8->keypad[0xB] =true; break;}
-                case SDLK_v:{chip8->keypad[0xF] =true; break;}
+                case SDLK_BACKSPACE:{shared->rewinding = true; break;}
+                case SDLK_1:{atomic_fetch_or(&shared->keys, 1u << 0x1); break;} //Handling Inputs 
+                case SDLK_2:{atomic_fetch_or(&shared->keys, 1u << 0x2); break;}
+                case SDLK_3:{atomic_fetch_or(&shared->keys, 1u << 0x3); break;}
+                case SDLK_4:{atomic_fetch_or(&shared->keys, 1u << 0xC); break;}
+
+                case SDLK_q:{atomic_fetch_or(&shared->keys, 1u << 0x4); break;}
+                case SDLK_w:{atomic_fetch_or(&shared->keys, 1u << 0x5); break;}
+                case SDLK_e:{atomic_fetch_or(&shared->keys, 1u << 0x6); break;}
+                case SDLK_r:{atomic_fetch_or(&shared->keys, 1u << 0xD); break;}
+
+                case SDLK_a:{atomic_fetch_or(&shared->keys, 1u << 0x7); break;}
+                case SDLK_s:{atomic_fetch_or(&shared->keys, 1u << 0x8); break;}
+                case SDLK_d:{atomic_fetch_or(&shared->keys, 1u << 0x9); break;}
+                case SDLK_f:{atomic_fetch_or(&shared->keys, 1u << 0xE); break;}
+
+                case SDLK_z:{atomic_fetch_or(&shared->keys, 1u << 0xA); break;}
+                case SDLK_x:{atomic_fetch_or(&shared->keys, 1u << 0x0); break;}
+                case SDLK_c:{atomic_fetch_or(&shared->keys, 1u << 0xB); break;}
+                case SDLK_v:{atomic_fetch_or(&shared->keys, 1u << 0xF); break;}
             }
             break;
         }
         
         case SDL_KEYUP:{
             switch(event.key.keysym.sym){
-
-                case SDLK_1:{chip8->keypad[0x1] =false; break;} //Handling Inputs 
-                case SDLK_2:{chip8->keypad[0x2] =false; break;}
-                case SDLK_3:{chip8->keypad[0x3] =false; break;}
-                case SDLK_4:{chip8->keypad[0xC] =false; break;}
-
-                case SDLK_q:{chip8->keypad[0x4] =false; break;}
-                case SDLK_w:{chip8->keypad[0x5] =false; break;}
-                case SDLK_e:{chip8->keypad[0x6] =false; break;}
-                case SDLK_r:{chip8->keypad[0xD] =false; break;}
-
-                case SDLK_a:{chip8->keypad[0x7] =false; break;}
-                case SDLK_s:{chip8->keypad[0x8] =false; break;}
-                case SDLK_d:{chip8->keypad[0x9] =false; break;}
-                case SDLK_f:{chip8->keypad[0xE] =false; break;}
-
-                case SDLK_z:{chip8->keypad[0xA] =false; break;}
-                case SDLK_x:{chip8->keypad[0x0] =false; break;}
-                case SDLK_c:{chip8->keypad[0xB] =false; break;}
-                case SDLK_v:{chip8->keypad[0xF] =false; break;}
+                case SDLK_BACKSPACE:{shared->rewinding = false; break;}
+
+                case SDLK_1:{atomic_fetch_and(&shared->keys, ~(1u << 0x1)); break;} //Handling Inputs 
+                case SDLK_2:{atomic_fetch_and(&shared->keys, ~(1u << 0x2)); break;}
+                case SDLK_3:{atomic_fetch_and(&shared->keys, ~(1u << 0x3)); break;}
+                case SDLK_4:{atomic_fetch_and(&shared->keys, ~(1u << 0xC)); break;}
+
+                case SDLK_q:{atomic_fetch_and(&shared->keys, ~(1u << 0x4)); break;}
+                case SDLK_w:{atomic_fetch_and(&shared->keys, ~(1u << 0x5)); break;}
+                case SDLK_e:{atomic_fetch_and(&shared->keys, ~(1u << 0x6)); break;}
+                case SDLK_r:{atomic_fetch_and(&shared->keys, ~(1u << 0xD)); break;}
+
+                case SDLK_a:{atomic_fetch_and(&shared->keys, ~(1u << 0x7)); break;}
+                case SDLK_s:{atomic_fetch_and(&shared->keys, ~(1u << 0x8)); break;}
+                case SDLK_d:{atomic_fetch_and(&shared->keys, ~(1u << 0x9)); break;}
+                case SDLK_f:{atomic_fetch_and(&shared->keys, ~(1u << 0xE)); break;}
+
+                case SDLK_z:{atomic_fetch_and(&shared->keys, ~(1u << 0xA)); break;}
+                case SDLK_x:{atomic_fetch_and(&shared->keys, ~(1u << 0x0)); break;}
+                case SDLK_c:{atomic_fetch_and(&shared->keys, ~(1u << 0xB)); break;}
+                case SDLK_v:{atomic_fetch_and(&shared->keys, ~(1u << 0xF)); break;}
             }
         }
             break;
         case SDL_WINDOWEVENT:{
             switch(event.window.event){
                 case SDL_WINDOWEVENT_RESIZED:{
-                    SDL_GetWindowSize(sdl->window, &config->res_x, &config->res_y);
                     SDL_DestroyRenderer(sdl->renderer);
                         sdl->renderer = SDL_CreateRenderer(
                             sdl->window,
                             -1,
-                            SDL_RENDERER_ACCELERATED
+                            SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC
                         ); //Creates Renderer using our pointer with said Parameters 
+                        create_texture(sdl);
                         clear_screen(sdl, config);
+                        sdl->upload = true; //New texture starts out blank
+                        sdl->redraw = true;
+                        if(sdl->show_hud){update_hud(sdl, shared, config);}
                     break;
                 }
             }
@@ -330,322 +374,419 @@ void user_input(chip8_type *chip8, sdl_type *sdl, config_type *config){
         }
             
     }
+    if((event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) && shared->keys != keys){note_key(shared, event.key.timestamp);} //Keypad key went up or down
 }
 
 
 }
 
-bool check_keypad(chip8_type *chip8, uint8_t *key_value){
-    for(uint8_t i = 0; i < 16 && *key_value == 0xFF ; i++){if(chip8->keypad[i]){*key_value = i; return true;}}
-    return false;
-}
-
-
-void emulate(chip8_type *chip8, config_type *config){
-    //bool carry; // Set our carry flag
-
-    //Have to or 2 bytes as one opcode is 2 bytes long 
-    chip8->inst.opcode.data[0] = chip8->ram[chip8->pc+1];
-    chip8->inst.opcode.data[1] = chip8->ram[chip8->pc];
+//Show the newest frame the emulation thread has finished, returns false if there was nothing to present.
+//res_x/res_y follow the frame, so they are 128x64 while a SUPER-CHIP ROM is in hi-res and 64x32 otherwise
+bool draw(sdl_type *sdl, frames_type *frames, config_type *config){
+    const bool fresh = frames_acquire(frames);
+    if(!fresh && !sdl->redraw){return false;}
+
+    //Only upload when the display changed or the texture was recreated, otherwise the texture already holds this frame
+    if(fresh || sdl->upload){
+        const frame_type *frame = frames_front(frames);
+        config->res_x = frame->hires ? 128 : 64;
+        config->res_y = frame->hires ? 64 : 32;
+        const uint32_t palette[2] = {config->bg_colour, config->fg_colour};
+        const SDL_Rect showing = {0, 0, config->res_x, config->res_y};
+        uint32_t *pixels;
+        int pitch;
+
+        SDL_LockTexture(sdl->texture, &showing, (void **)&pixels, &pitch);
+        for (int y = 0; y < config->res_y; y++) {
+            uint32_t *row = pixels + y * (pitch / sizeof(uint32_t));
+            for (int x = 0; x < config->res_x; x++) {row[x] = palette[(frame->display[y][x >> 6] >> (63 - (x & 63))) & 1];}
+        }
+        SDL_UnlockTexture(sdl->texture);
+    }
 
-    chip8->pc += 2;
+    //One copy of the part that's showing, scaled to whatever size the window is
+    const SDL_Rect showing = {0, 0, config->res_x, config->res_y};
+    SDL_RenderCopy(sdl->renderer, sdl->texture, &showing, NULL);
+    if(sdl->show_hud){
+        //Half the window wide, keeping the overlay's shape
+        int w, h;
+        SDL_GetRendererOutputSize(sdl->renderer, &w, &h);
+        const SDL_Rect where = {0, 0, w / 2, w / 2 * HUD_HEIGHT / HUD_WIDTH};
+        SDL_RenderCopy(sdl->renderer, sdl->hud, NULL, &where);
+    }
+    SDL_RenderPresent(sdl->renderer);
+    sdl->redraw = false;
+    sdl->upload = false;
+    return true;
+}
 
-    chip8->inst.NNN = chip8->inst.opcode.full_op & 0x0FFF; // Immediate Memory address, we want to mask of the last 3 nibbles
-    chip8->inst.NN = chip8->inst.opcode.full_op & 0x0FF; // 8bit immediate number 
-    chip8->inst.N = chip8->inst.opcode.full_op & 0x0F; //N nibble 
-    chip8->inst.X = (chip8->inst.opcode.full_op >> 8) & 0x0F; // X register 
-    chip8->inst.Y = (chip8->inst.opcode.full_op >> 4) & 0x0F; // Y register
+//Hand the display to the SDL thread
+void publish(shared_type *shared){
+    memcpy(frames_back(&shared->frames)->display, shared->chip8->display, sizeof shared->chip8->display);
+    frames_back(&shared->frames)->hires = shared->chip8->hires;
+    frames_back(&shared->frames)->cycles = shared->chip8->cycles;
+    frames_publish(&shared->frames);
+    shared->chip8->draw = false;
+}
 
+//Hand the sound timer, pattern and pitch to the audio callback, the pattern only goes across when it changed
+void post_sound(shared_type *shared, bool active){
+    audio_post(&shared->audio, active, shared->chip8->pattern, shared->chip8->pitch);
+}
 
+//A movie only holds keypad changes, so anything else that moves the machine ends it
+void stop_recording(shared_type *shared, const char *why){
+    if(!shared->movie.file){return;}
+    movie_finish(&shared->movie, shared->chip8);
+    SDL_Log("Stopped recording, %s", why);
+}
 
-    
+//Profile builds (make profile) print where the instructions went, other builds have nothing to report
+void report(const chip8_type *chip8){
+#ifdef CHIP8_PROFILE
+    profile_report(chip8, stdout);
+
+    char path[64];
+    snprintf(path, sizeof path, "%s.folded", chip8->rom_name);
+    FILE *folded = fopen(path, "w");
+    if(!folded){SDL_Log("Could not open %s for writing", path); return;}
+    profile_folded(chip8, folded);
+    fclose(folded);
+    printf("Call stacks written to %s, for flame graph tools\n", path);
+#else
+    (void)chip8;
+#endif
+}
 
-    switch((chip8->inst.opcode.full_op & 0xF000) >> 12){ //Masks opcode so we only get 0xA000 where A is our Opcode
-        case 0x0:{
-            switch(chip8->inst.NN){
-                case 0xE0:{memset(&chip8->display[0], false, sizeof(chip8->display)); chip8->draw = true; break;} //Clear display
-                case 0xEE:{chip8->pc = *--chip8->stkptr; break;} //Pop off current subroutine and set pc to that subroutine
-            }
+//Save states happen here between frames, so only the emulation thread ever touches chip8
+void run_command(shared_type *shared){
+    static state_type state; //Over 4K, keep it off the stack
+    switch(atomic_exchange(&shared->command, CMD_NONE)){
+        case(CMD_SAVE):{
+            save_state(shared->chip8, &state);
+            if(write_state(&state, shared->state_path)){SDL_Log("Saved state to %s", shared->state_path);}
             break;
         }
-        case(0x1):{chip8->pc = chip8->inst.NNN; break;} // Jump to address NNN
-        case(0x2):{*chip8->stkptr++ = chip8->pc; chip8->pc = chip8->inst.NNN; break;}
-        case(0x3):{if(chip8->V[chip8->inst.X] == chip8->inst.NN){chip8->pc += 2;} break;} //If VX is equal to NN increment PC
-        case(0x4):{if(chip8->V[chip8->inst.X] != chip8->inst.NN){chip8->pc += 2;} break;} //If VX is not equal to NN increment PC
-        case(0x5):{if(chip8->V[chip8->inst.X] == chip8->V[chip8->inst.Y]){chip8->pc += 2;} break;} // If VX == VY increment PC
-        case(0x6):{chip8->V[chip8->inst.X] = chip8->inst.NN; break;} //Set VX = NN
-        case(0x7):{chip8->V[chip8->inst.X] += chip8->inst.NN; break;} // Increment VX by the value NN
-        case(0x8):{
-            switch((chip8->inst.opcode.full_op & 0x000F)){
-                case(0x0):{chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y]; break;}
-                case(0x1):{chip8->V[chip8->inst.X] = chip8->V[chip8->inst.X] | chip8->V[chip8->inst.Y]; break;}
-                case(0x2):{chip8->V[chip8->inst.X] = chip8->V[chip8->inst.X] & chip8->V[chip8->inst.Y]; break;}
-                case(0x3):{chip8->V[chip8->inst.X] = chip8->V[chip8->inst.X] ^ chip8->V[chip8->inst.Y]; break;}
-                case(0x4):{
-                    uint16_t result = chip8->V[chip8->inst.X] + chip8->V[chip8->inst.Y];
-                    chip8->V[0xF] = (result > 0xFF) ? 1 : 0;
-                    chip8->V[chip8->inst.X] = (uint8_t)result;
-                    break;
-                }
-                case(0x5):{
-                    chip8->V[chip8->inst.X] -= chip8->V[chip8->inst.Y];
-                    chip8->V[0xF] = (chip8->V[chip8->inst.X] >= chip8->V[chip8->inst.Y]) ? 1 : 0;
-                    break; 
-                    }
-                case(0x6):{
-                    switch(config->choice){
-                        case(COSMAC):{
-                                chip8->V[0xF] = (chip8->V[chip8->inst.Y] & 0x1);
-                                chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] >> 1;
-                                break;
-                        }
-                        case(AMIGA):{
-                                chip8->V[0xF] = (chip8->V[chip8->inst.X] & 0x1);
-                                chip8->V[chip8->inst.X] >>= 1;
-                                break;
-                        }
-                    }
-                    break;
-                }
-                case(0x7):{
-                    chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] - chip8->V[chip8->inst.X];
-                    chip8->V[0xF] = (chip8->V[chip8->inst.Y] >= chip8->V[chip8->inst.X]) ? 1 : 0;
-                    break;
-                }
-                case(0xE):{
-                    switch(config->choice){
-                            case(COSMAC):{
-                                chip8->V[0xF] = (chip8->V[chip8->inst.Y] & 0x80) >> 7;
-                                chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] << 1;
-                                break;
-                        }
-                        case(AMIGA):{
-                                chip8->V[0xF] = (chip8->V[chip8->inst.X] & 0x80) >> 7;
-                                chip8->V[chip8->inst.X] <<= 1;
-                                break;
-                        }
-
-                    }
-                    break;
-                }
-
+        case(CMD_LOAD):{
+            if(read_state(&state, shared->state_path) && load_state(shared->chip8, &state)){
+                stop_recording(shared, "a state was loaded");
+                SDL_Log("Loaded state from %s", shared->state_path);
+                publish(shared); //Show it straight away, even while paused
             }
-        }
-        break;
-        case(0x9):{if(chip8->V[chip8->inst.X] != chip8->V[chip8->inst.Y]){chip8->pc += 2; }break;}
-        case(0xA):{chip8->I = chip8->inst.NNN; break;}
-        case(0xB):{
-            switch(config->choice){
-                case(COSMAC):{
-                    chip8->pc = chip8->inst.NNN + chip8->V[0];
-                    break;
-                }
-                case(AMIGA):{
-                    chip8->pc = chip8->inst.NNN + chip8->V[chip8->inst.X];
-                    break;
-                }
-            }   
             break;
         }
-        case(0xC):{srand(time(NULL)); uint8_t random = rand(); chip8->V[chip8->inst.X] = random & chip8->inst.NN; break;}
-        case(0xD):{
-             // 0xDXYN: Draw N-height sprite at coords X,Y; Read from memory location I;
-            //   Screen pixels are XOR'd with sprite bits, 
-            //   VF (Carry flag) is set if any screen pixels are set off; This is useful
-            //   for collision detection or other reasons.
-            
-            uint8_t X_coord = chip8->V[chip8->inst.X] % 64;
-            uint8_t Y_coord = chip8->V[chip8->inst.Y] % 32;
-            const uint8_t orig_X = X_coord; // Original X value
-
-            chip8->V[0xF] = 0;  // Initialize carry flag to 0   
-
-            // Loop over all N rows of the sprite
-            for (uint8_t i = 0; i < chip8->inst.N; i++) {
-                // Get next byte/row of sprite data
-                const uint8_t sprite_data = chip8->ram[chip8->I + i];
-                X_coord = orig_X;   // Reset X for next row to draw
-
-                for (int8_t j = 7; j >= 0; j--) {
-                    // If sprite pixel/bit is on and display pixel is on, set carry flag
-                    bool *pixel = &chip8->display[Y_coord * 64 + X_coord]; 
-                    const bool sprite_bit = (sprite_data & (1 << j));
-
-                    if (sprite_bit && *pixel) {
-                        chip8->V[0xF] = 1;  
-                    }
-
-                    // XOR display pixel with sprite pixel/bit to set it on or off
-                    *pixel ^= sprite_bit;
+        case(CMD_PROFILE):{report(shared->chip8); break;}
+        default:{break;}
+    }
+}
 
-                    // Stop drawing this row if hit right edge of screen
-                    if (++X_coord >= 64) break;
-                }
+//Hand the last second of statistics to the HUD
+void publish_stats(shared_type *shared, stats_type *stats, const sched_type *sched){
+    shared->late = (int)stats->window_late;
+    shared->dropped = (int)(sched->dropped - stats->window_dropped);
+    stats->window_late = 0;
+    stats->window_dropped = sched->dropped;
+    const histogram_type *latency = &stats->window_latency;
+    shared->latency_mean_us = latency->count ? (int)(latency->sum_us / latency->count) : -1;
+    shared->latency_max_us = latency->count ? (int)latency->max_us : -1;
+    histogram_clear(&stats->window_latency);
+}
 
-                // Stop drawing entire sprite if hit bottom edge of screen
-                if (++Y_coord >= 32) break;
-            }
-            chip8->draw = true; // Will update screen on next 60hz tick
-            break;
+//Runs the emulator at 60 frames a second and hands finished frames to the SDL thread, never waits on it
+int emulation_thread(void *data){
+    shared_type *shared = data;
+    chip8_type *chip8 = shared->chip8;
+    const uint64_t freq = SDL_GetPerformanceFrequency();
+    sched_type sched;
+    sched_init(&sched, shared->insts_per_sec, 60, SDL_GetPerformanceCounter(), freq);
+    static rewind_type history; //Two states of scratch in it, keep it off the stack
+    if(!rewind_init(&history, shared->rewind_seconds) && shared->rewind_seconds > 0){SDL_Log("Could not allocate rewind history, rewind is off");}
+    stats_type *stats = &shared->stats;
+    uint64_t window = SDL_GetPerformanceCounter();
+    bool paused = false;
+
+    while(shared->state != QUIT){
+        run_command(shared);
+        if(shared->state == PAUSED){paused = true; post_sound(shared, false); SDL_Delay(16); continue;}
+        if(paused){
+            //Time spent paused was never due, so it isn't late or dropped
+            sched_resync(&sched, SDL_GetPerformanceCounter());
+            paused = false;
         }
-        case(0xE):{
-            switch(chip8->inst.NN){
-                case(0x9E):{if(chip8->keypad[chip8->V[chip8->inst.X]]){chip8->pc += 2;} break;}
-                case(0xA1):{if(!chip8->keypad[chip8->V[chip8->inst.X]]){chip8->pc += 2;} break;}
-            }
+        const uint64_t frame = SDL_GetPerformanceCounter();
+        stats_frame(stats, frame, sched_deadline(&sched));
+        if(frame - window >= freq){publish_stats(shared, stats, &sched); window = frame;}
+
+        int ran = 0; //Stays 0 for a rewind frame, which runs nothing and shouldn't count towards IPS
+
+        if(shared->rewinding){
+            //A frame back per frame, so history plays backwards at normal speed
+            const uint64_t t = phase_start(shared);
+            if(rewind_pop(&history, chip8)){stop_recording(shared, "rewound"); publish(shared);}
+            post_sound(shared, false);
+            phase_end(shared, TRACE_EMU, "rewind", t);
         }
-            break;
-        case(0xF):{
-            switch(chip8->inst.NN){
-                case(0x07):{chip8->V[chip8->inst.X] = chip8->delay_timer; break;}
-                case(0x0A):{
-                    uint8_t key_value = 0xFF;
-                    bool key_pressed = false;
-                    key_pressed = check_keypad(chip8, &key_value);
-
-                    if(!key_pressed){chip8->pc -= 2; break;}
-                    chip8->V[chip8->inst.X] = key_value;
-                    break;
-                }
-                case(0x15):{chip8->delay_timer = chip8->V[chip8->inst.X]; break;}
-                case(0x18):{chip8->sound_timer = chip8->V[chip8->inst.X]; break;}
-                case(0x1E):{
-                    switch(config->choice){
-                        case 0:{chip8->I += chip8->V[chip8->inst.X]; break;}
-                        case 1:{
-                            uint32_t result = chip8->I + chip8->V[chip8->inst.X]; 
-                            chip8->V[0xF] = (result > 0xFFF) ? 1 : 0;
-                            chip8->I = (uint16_t)result;
-                            break;
-                        }
-                    }
-                    break;
-                }
-                case(0x29):{chip8->I = chip8->V[chip8->inst.X] * 5; break;}
-                case(0x33):{
-                    uint8_t va = chip8->V[chip8->inst.X];
-                    chip8->ram[chip8->I+2] = va % 10;
-                    va /= 10;
-                    chip8->ram[chip8->I+1] = va % 10;
-                    va /= 10;
-                    chip8->ram[chip8->I] = va;
-                    break;
-                }
-            case(0x55):{
-                switch(config->choice){
-                    case(COSMAC):{for(int i = 0; i <= chip8->inst.X; i++){chip8->ram[chip8->I+i] = chip8->V[i];} chip8->I = chip8->inst.X + 1; break;}
-                    case(AMIGA):{for(int i = 0; i <= chip8->inst.X; i++){chip8->ram[chip8->I+i] = chip8->V[i];} break;}
-                }
-                break;
-            }
-            case(0x65):{
-                switch(config->choice){
-                    case(COSMAC):{for(int i = 0; i <= chip8->inst.X; i++){chip8->V[i] = chip8->ram[chip8->I+i];} chip8->I = chip8->inst.X + 1; break;}
-                    case(AMIGA):{for(int i = 0; i <= chip8->inst.X; i++){chip8->V[i] = chip8->ram[chip8->I+i];} break;}
-                }
-                break;
-            }
-            
-            }
+        else{
+            const uint64_t key_event = atomic_exchange(&shared->key_event, 0); //Taken before the keys, so they include its change
+            const unsigned int keys = shared->keys;
+            for(uint8_t i = 0; i < 16; i++){chip8->keypad[i] = (keys >> i) & 1;}
+            movie_keys(&shared->movie, chip8, keys);
+
+            uint64_t t = SDL_GetPerformanceCounter();
+            if(key_event){stats_latency(stats, key_event, t);}
+            ran = sched_frame_insts(&sched);
+            shared->engine(chip8, ran);
+            phase_end(shared, TRACE_EMU, "emulate", t);
+
+            //Timer as the frame's last instruction saw it, so a one tick beep still sounds for its frame
+            post_sound(shared, chip8->cycles && read_timer(chip8, chip8->sound_expires, chip8->cycles - 1));
+
+            t = phase_start(shared);
+            if(chip8->draw){publish(shared);}
+            rewind_push(&history, chip8);
+            phase_end(shared, TRACE_EMU, "publish/capture", t);
         }
 
+        sched_end_frame(&sched, SDL_GetPerformanceCounter(), ran);
+        shared->measured_ips = (int)sched.measured_ips;
+        shared->measured_fps_x10 = (int)(sched.measured_fps * 10);
+        phase_end(shared, TRACE_EMU, "frame", frame);
+
+        //Sleep to the next deadline, rounded up so a frame never starts early
+        const uint64_t deadline = sched_deadline(&sched);
+        const uint64_t now = SDL_GetPerformanceCounter();
+        if(deadline > now){
+            const uint64_t t = phase_start(shared);
+            SDL_Delay((uint32_t)(((deadline - now) * 1000 + freq - 1) / freq));
+            phase_end(shared, TRACE_EMU, "SDL_Delay", t);
+        }
     }
+    post_sound(shared, false);
+    rewind_free(&history);
+    stop_recording(shared, "emulator closed");
+    shared->dropped = (int)sched.dropped; //Final count for the summary main() prints once both threads are done
+    report(chip8);
+    return 0;
 }
 
-void update_timers(chip8_type *chip8){
-    if(chip8->delay_timer > 0){chip8->delay_timer--;}
+//Writes the trace out a few times a second, so neither traced thread ever waits on the file
+int trace_thread(void *data){
+    shared_type *shared = data;
+    while(shared->state != QUIT){
+        trace_flush(shared->trace);
+        SDL_Delay(100);
+    }
+    return 0;
+}
 
+//Measured against target rates in the title bar (and the HUD if it's up), once a second is plenty
+void show_rates(sdl_type *sdl, shared_type *shared, const config_type *config){
+    static uint32_t last;
+    const uint32_t now = SDL_GetTicks();
+    if(now - last < 1000){return;}
+    last = now;
+    if(sdl->show_hud){update_hud(sdl, shared, config);}
+    histogram_clear(&shared->stats.window_frames); //Next second's presents, whether or not the HUD showed this one's
+    const int insts_per_sec = config->insts_per_sec;
+
+    char title[100];
+    const int fps_x10 = shared->measured_fps_x10;
+    snprintf(title, sizeof title, "CHIP-8 Emulator - %d/%d IPS, %d.%d/60 FPS", (int)shared->measured_ips, insts_per_sec, fps_x10 / 10, fps_x10 % 10);
+    SDL_SetWindowTitle(sdl->window, title);
+}
 
-    if(chip8->sound_timer > 0){
-        chip8->sound_timer--;
-        //SDL_PauseAudioDevice(,0)
+//Command line options, anything not given here comes from config.txt
+typedef struct{
+    bool bench;         //Headless with no pacing, prints the rates and exits
+    uint64_t frames;    //Stop the bench after this many frames
+    uint64_t insts;     //Or after this many instructions, whichever is set
+    const char *state;  //Save state to start from, also where F5/F9 save and load
+    const char *record; //Movie to record the keypad into
+    const char *replay; //Movie to play back headless instead of opening a window
+    const char *trace;  //Chrome trace of the frame phases
+} args_type;
+
+bool parse_args(int argc, char *argv[], args_type *args, config_type *config){
+    for(int i = 1; i < argc; i++){
+        const bool has_value = i + 1 < argc;
+        if(!strcmp(argv[i], "--bench")){args->bench = true;}
+        else if(!strcmp(argv[i], "--frames") && has_value){args->frames = strtoull(argv[++i], NULL, 0);}
+        else if(!strcmp(argv[i], "--insts") && has_value){args->insts = strtoull(argv[++i], NULL, 0);}
+        else if(!strcmp(argv[i], "--ips") && has_value){config->insts_per_sec = atoi(argv[++i]);}
+        else if(!strcmp(argv[i], "--dispatch") && has_value){config->dispatch = atoi(argv[++i]);}
+        else if(!strcmp(argv[i], "--seed") && has_value){config->seed = (uint32_t)strtoul(argv[++i], NULL, 0);}
+        else if(!strcmp(argv[i], "--state") && has_value){args->state = argv[++i];}
+        else if(!strcmp(argv[i], "--record") && has_value){args->record = argv[++i];}
+        else if(!strcmp(argv[i], "--replay") && has_value){args->replay = argv[++i];}
+        else if(!strcmp(argv[i], "--trace") && has_value){args->trace = argv[++i];}
+        else if(!strcmp(argv[i], "--rom") && has_value){strlcpy(config->rom_name, argv[++i], sizeof config->rom_name);}
+        else{
+            fprintf(stderr, "Usage: %s [--bench] [--frames N | --insts N] [--ips N] [--dispatch N] [--seed N] [--state file] [--record file | --replay file] [--trace file] [--rom file]\n", argv[0]);
+            return false;
         }
-    //else{
-        //SDL_PauseAudioDevice(,1);
-   // }
-
-
-
-
+    }
+    if(args->bench && !args->frames && !args->insts){args->frames = 36000;} //Ten emulated minutes
+    return true;
 }
 
-void draw(const sdl_type sdl, chip8_type *chip8, const config_type config){
-   SDL_Rect rect = {.x = 0, .y = 0, .w = 20, .h = 20};
-
-
+//Runs frames back to back with no window, no sleeping and no input. Timers run off the cycle counter,
+//so ROMs take the same path they would on screen. Only the wall clock is read, once either side
+void bench(chip8_type *chip8, engine_type engine, const config_type *config, const args_type *args){
+    sched_type sched;
+    sched_init(&sched, config->insts_per_sec, 60, 0, 1); //Counter never moves, so it only hands out instructions
+
+    const uint32_t seed = chip8->rng; //Same seed gives the same run
+    uint64_t insts = 0;
+    const uint64_t start = SDL_GetPerformanceCounter();
+    while(args->frames ? sched.frame < args->frames : insts < args->insts){
+        int count = sched_frame_insts(&sched);
+        if(!args->frames && args->insts - insts < (uint64_t)count){count = (int)(args->insts - insts);} //Last frame only runs what is left, so --insts is exact
+        engine(chip8, count);
+        chip8->draw = false;
+        insts += count;
+        sched_end_frame(&sched, 0, count);
+    }
+    const double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
 
-    // Loop through display pixels, draw a rectangle per pixel to the SDL window
-    for (uint32_t i = 0; i < sizeof chip8->display; i++) {
-        // Translate 1D index i value to 2D X/Y coordinates
-        // X = i % window width
-        // Y = i / window width
-        rect.x = (i % config.res_x) * config.sf;
-        rect.y = (i / config.res_x) * config.sf;
+    printf("%s, dispatch %d, seed %u: %llu instructions, %llu frames in %.3f s\n", config->rom_name, config->dispatch, (unsigned)seed,
+        (unsigned long long)insts, (unsigned long long)sched.frame, seconds);
+    printf("%.2f MIPS, %.0f FPS (%.0fx real time)\n", insts / seconds / 1e6, sched.frame / seconds, sched.frame / seconds / 60);
+    report(chip8);
+}
 
-        if (chip8->display[i]) {
-            // Pixel is on, draw foreground color
-            SDL_SetRenderDrawColor(sdl.renderer, 255, 255, 255, 255);
-            SDL_RenderFillRect(sdl.renderer, &rect);
-        } 
-        else {
-            SDL_SetRenderDrawColor(sdl.renderer, 0, 0, 0, 255);
-            SDL_RenderFillRect(sdl.renderer, &rect);
-        }
+//Plays a movie back as fast as the engine goes, in batches that end on every keypad change. Returns
+//false if it doesn't finish in exactly the state the recording did
+bool replay(config_type *config, const args_type *args){
+    static movie_type movie;
+    if(!movie_open(&movie, args->replay)){return false;}
+    config->choice = movie.header.choice; //Same machine it was recorded on, the ROM itself comes from the start state
+    config->insts_per_sec = movie.header.ips;
+
+    static chip8_type chip8;
+    if(!init_chip8(&chip8, config)){return false;}
+    const engine_type engine = select_engine(&chip8, config);
+    if(!movie_start(&movie, &chip8)){return false;}
+
+    const uint64_t first = chip8.cycles;
+    const uint64_t start = SDL_GetPerformanceCounter();
+    while(movie_apply(&movie, &chip8)){
+        const uint64_t left = movie_until(&movie, &chip8);
+        engine(&chip8, left > INT32_MAX ? INT32_MAX : (int)left);
+        chip8.draw = false;
     }
+    const double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    const uint64_t insts = chip8.cycles - first;
+    const bool same = movie_check(&movie, &chip8);
+
+    printf("%s, dispatch %d: %llu keypad events, %llu instructions in %.3f s (%.2f MIPS)\n", args->replay, config->dispatch,
+        (unsigned long long)movie.events, (unsigned long long)insts, seconds, insts / seconds / 1e6);
+    printf("%s\n", same ? "Final state matches the recording" : "Final state differs from the recording");
+    report(&chip8);
+    jit_destroy(chip8.jit);
+    free(chip8.aot_stale);
+    return same;
+}
 
-    SDL_RenderPresent(sdl.renderer);
-
+//Start from the save state given on the command line, if there is one
+bool start_state(chip8_type *chip8, const args_type *args){
+    if(!args->state){return true;}
+    static state_type state;
+    return read_state(&state, args->state) && load_state(chip8, &state);
 }
 
 int main(int argc, char *argv[]){
-    (void) argc;
-    (void) argv;
     config_type config = {0};
     read_in_config(&config);
 
+    args_type args = {0};
+    if(!parse_args(argc, argv, &args, &config)){exit(EXIT_FAILURE);}
+    if(config.insts_per_sec <= 0){SDL_Log("insts_per_second must be above 0, using 700"); config.insts_per_sec = 700;}
+
+    if(args.replay){exit(replay(&config, &args) ? EXIT_SUCCESS : EXIT_FAILURE);}
+
+    if(args.bench){
+        static chip8_type bench_chip8;
+        if(!init_chip8(&bench_chip8, &config)){exit(EXIT_FAILURE);}
+        const engine_type engine = select_engine(&bench_chip8, &config);
+        if(!start_state(&bench_chip8, &args)){exit(EXIT_FAILURE);}
+        bench(&bench_chip8, engine, &config, &args);
+        jit_destroy(bench_chip8.jit);
+        free(bench_chip8.aot_stale);
+        exit(EXIT_SUCCESS);
+    }
+
     // Intialise SDL 
     sdl_type sdl = {0}; //Create SDL "Object"
-    chip8_type chip8 = {0}; 
+    static chip8_type chip8; //Too big for the stack, around 140KB in the profile build
 
     if(!init_sdl(&sdl, &config)){exit(EXIT_FAILURE);}
     if(!init_chip8(&chip8, &config)){exit(EXIT_FAILURE);}
 
-    clear_screen(&sdl, &config);
-
-    while(chip8.state != QUIT){
-        user_input(&chip8, &sdl, &config);
-        if(chip8.state  == PAUSED){continue;}
+    static shared_type shared; //Too big for the stack with the frame buffers in it
+    shared.chip8 = &chip8;
+    shared.engine = select_engine(&chip8, &config);
+    if(!start_state(&chip8, &args)){exit(EXIT_FAILURE);}
+    if(args.record && !movie_record(&shared.movie, args.record, &chip8, &config)){exit(EXIT_FAILURE);}
+    shared.insts_per_sec = config.insts_per_sec;
+    frames_init(&shared.frames);
+    atomic_init(&shared.state, RUNNING);
+    atomic_init(&shared.keys, 0);
+    atomic_init(&shared.command, CMD_NONE);
+    atomic_init(&shared.rewinding, false);
+    atomic_init(&shared.key_event, 0);
+    atomic_init(&shared.latency_mean_us, -1);
+    stats_init(&shared.stats, SDL_GetPerformanceFrequency());
+    shared.rewind_seconds = config.rewind_seconds;
+    init_audio(&sdl, &config, &shared.audio);
+    if(args.state){strlcpy(shared.state_path, args.state, sizeof shared.state_path);}
+    else{snprintf(shared.state_path, sizeof shared.state_path, "%s.state", config.rom_name);}
 
-        const uint64_t start_time = SDL_GetPerformanceCounter();
+    clear_screen(&sdl, &config);
+    sdl.redraw = true;
+
+    static trace_type trace; //A ring of events per thread, far too big for the stack
+    SDL_Thread *tracer = NULL;
+    if(args.trace){
+        const char *const names[TRACE_THREADS] = {[TRACE_SDL] = "SDL", [TRACE_EMU] = "emulation"};
+        if(!trace_open(&trace, args.trace, names, SDL_GetPerformanceCounter(), SDL_GetPerformanceFrequency())){exit(EXIT_FAILURE);}
+        shared.trace = &trace;
+        tracer = SDL_CreateThread(trace_thread, "trace", &shared);
+        if(!tracer){SDL_Log("Could not create trace thread %s\n", SDL_GetError()); exit(EXIT_FAILURE);}
+    }
 
-        for(int i = 0; i < config.insts_per_sec / 60; i++){
-            emulate(&chip8,&config);
+    SDL_Thread *thread = SDL_CreateThread(emulation_thread, "emulation", &shared);
+    if(!thread){SDL_Log("Could not create emulation thread %s\n", SDL_GetError()); exit(EXIT_FAILURE);}
+
+    //This thread only handles input and presents, so a slow present or a resize never holds up emulation
+    const uint64_t frame_insts = config.insts_per_sec / 60 > 0 ? config.insts_per_sec / 60 : 1;
+    while(shared.state != QUIT){
+        uint64_t t = phase_start(&shared);
+        user_input(&shared, &sdl, &config);
+        phase_end(&shared, TRACE_SDL, "user_input", t);
+
+        t = phase_start(&shared);
+        const bool drew = draw(&sdl, &shared.frames, &config);
+        if(drew){phase_end(&shared, TRACE_SDL, "draw/SDL_RenderPresent", t);}
+        if(shared.state != RUNNING){stats_break(&shared.stats);}
+        else if(drew){stats_present(&shared.stats, frames_front(&shared.frames)->cycles, frame_insts, SDL_GetPerformanceCounter());}
+        else{
+            t = phase_start(&shared);
+            SDL_Delay(1); //Nothing new to show, don't spin
+            phase_end(&shared, TRACE_SDL, "SDL_Delay", t);
         }
-
-        const uint64_t end_time = SDL_GetPerformanceCounter();
-
-        const double elapsed_time = (double)((end_time - start_time) * 1000) / SDL_GetPerformanceFrequency();
-
-
-
-    
-
-        SDL_Delay(16.67f > elapsed_time ? 16.67f - elapsed_time : 0);
-
-        if(chip8.draw){draw(sdl,&chip8, config); chip8.draw = false;}
-        update_timers(&chip8);
- 
-        
-
+        show_rates(&sdl, &shared, &config);
     }
 
+    SDL_WaitThread(thread, NULL);
+    stats_summary(&shared.stats, (uint64_t)shared.dropped, stdout);
+    if(tracer){
+        SDL_WaitThread(tracer, NULL);
+        trace_close(&trace);
+        SDL_Log("Trace written to %s", args.trace);
+    }
 
-    
-
-
-
-    
-  
+    jit_destroy(chip8.jit);
+    free(chip8.aot_stale);
 
     //Ends SDL
     end(&sdl);
@@ -681,7 +822,6 @@ FX65
 
 
 
-Super Chip
 Xo chip 
 
 */
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include "movie.h"
+
+//FNV-1a over the save state, which holds the display, so equal hashes mean equal frames too
+uint32_t state_hash(const chip8_type *chip8){
+    static state_type state; //Never written anywhere but here, so its padding stays zero
+    save_state(chip8, &state);
+    const uint8_t *bytes = (const uint8_t *)&state;
+    uint32_t hash = 2166136261u;
+    for(size_t i = 0; i < sizeof state; i++){hash = (hash ^ bytes[i]) * 16777619u;}
+    return hash;
+}
+
+static bool write_event(movie_type *movie, uint64_t cycle, uint32_t keys, uint32_t check){
+    const movie_event event = {.cycle = cycle, .keys = keys, .check = check};
+    movie->events++;
+    return fwrite(&event, sizeof event, 1, movie->file) == 1;
+}
+
+//Start recording from chip8 as it is now
+bool movie_record(movie_type *movie, const char *path, const chip8_type *chip8, const config_type *config){
+    memset(movie, 0, sizeof *movie);
+    movie->file = fopen(path, "wb");
+    if(!movie->file){fprintf(stderr, "Could not open %s for writing\n", path); return false;}
+
+    movie->header.magic = MOVIE_MAGIC;
+    movie->header.version = MOVIE_VERSION;
+    movie->header.choice = config->choice;
+    movie->header.ips = config->insts_per_sec;
+    save_state(chip8, &movie->header.start);
+    if(fwrite(&movie->header, sizeof movie->header, 1, movie->file) != 1){fclose(movie->file); movie->file = NULL; return false;}
+    return true;
+}
+
+//Keypad about to be used from chip8->cycles on, only changes are written
+void movie_keys(movie_type *movie, const chip8_type *chip8, uint32_t keys){
+    if(!movie->file || keys == movie->keys){return;}
+    write_event(movie, chip8->cycles, keys, 0);
+    movie->keys = keys;
+}
+
+bool movie_finish(movie_type *movie, const chip8_type *chip8){
+    if(!movie->file){return false;}
+    const bool written = write_event(movie, chip8->cycles, MOVIE_END, state_hash(chip8));
+    const bool closed = fclose(movie->file) == 0;
+    movie->file = NULL;
+    return written && closed;
+}
+
+//Read the header and the first event, the caller sets up chip8 from header.choice and header.ips
+bool movie_open(movie_type *movie, const char *path){
+    memset(movie, 0, sizeof *movie);
+    movie->file = fopen(path, "rb");
+    if(!movie->file){fprintf(stderr, "Could not open movie %s\n", path); return false;}
+
+    if(fread(&movie->header, sizeof movie->header, 1, movie->file) != 1 || movie->header.magic != MOVIE_MAGIC || movie->header.version != MOVIE_VERSION){
+        fprintf(stderr, "%s is not a version %d movie\n", path, MOVIE_VERSION);
+        fclose(movie->file);
+        movie->file = NULL;
+        return false;
+    }
+    //Same limits read_in_config() and main() put on config.txt, a bad choice indexes past the quirk profiles and an ips of 0 divides by zero in timer_ticks()
+    if(movie->header.choice < 0 || movie->header.choice > XOCHIP || movie->header.ips <= 0){
+        fprintf(stderr, "%s has emulator_type %d or insts_per_second %d out of range\n", path, movie->header.choice, movie->header.ips);
+        fclose(movie->file);
+        movie->file = NULL;
+        return false;
+    }
+    if(fread(&movie->next, sizeof movie->next, 1, movie->file) != 1){movie->next = (movie_event){.cycle = 0, .keys = MOVIE_END};} //Cut short, replay what there is
+    return true;
+}
+
+//Put chip8 in the state recording started from, keypad all up
+bool movie_start(movie_type *movie, chip8_type *chip8){
+    memset(chip8->keypad, 0, sizeof chip8->keypad);
+    movie->keys = 0;
+    return load_state(chip8, &movie->header.start);
+}
+
+//Instructions to run before the next event (or the end) is due
+uint64_t movie_until(const movie_type *movie, const chip8_type *chip8){
+    return movie->next.cycle > chip8->cycles ? movie->next.cycle - chip8->cycles : 0;
+}
+
+//Apply every event due at chip8->cycles, false once the end is reached
+bool movie_apply(movie_type *movie, chip8_type *chip8){
+    while(movie->next.keys != MOVIE_END && movie->next.cycle <= chip8->cycles){
+        movie->keys = movie->next.keys;
+        movie->events++;
+        if(fread(&movie->next, sizeof movie->next, 1, movie->file) != 1){movie->next = (movie_event){.cycle = chip8->cycles, .keys = MOVIE_END};}
+    }
+    for(uint8_t i = 0; i < 16; i++){chip8->keypad[i] = (movie->keys >> i) & 1;}
+    return movie->next.keys != MOVIE_END || movie->next.cycle > chip8->cycles;
+}
+
+//At the end of a replay, true if it landed on exactly the state the recording finished in
+bool movie_check(movie_type *movie, const chip8_type *chip8){
+    const bool same = movie->next.keys == MOVIE_END && movie->next.cycle == chip8->cycles && movie->next.check == state_hash(chip8);
+    fclose(movie->file);
+    movie->file = NULL;
+    return same;
+}
@@ -0,0 +1,49 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include "state.h"
+
+//Input movies. Everything but the keypad is already deterministic (the timers run off the cycle counter
+//and CXNN off a seeded generator), so a run is its starting state plus every keypad change stamped
+//with the cycle it happened on. The file is a header holding the starting save state, then one event per
+//change, then an end event with the cycle count and a hash of the final state so a replay can check itself.
+
+#define MOVIE_MAGIC 0x564D3843u //"C8MV" read as a little endian word
+#define MOVIE_VERSION 1
+#define MOVIE_END 0x10000u //keys value of the end event, no keypad state uses bit 16
+
+typedef struct{
+    uint32_t magic;
+    uint32_t version;
+    int32_t choice; //emulator_type and insts_per_second it was recorded under, the timers depend on ips
+    int32_t ips;
+    state_type start;
+} movie_header;
+
+typedef struct{
+    uint64_t cycle;
+    uint32_t keys;  //Bit per keypad key, or MOVIE_END
+    uint32_t check; //state_hash() of the final state in the end event, 0 otherwise
+} movie_event;
+
+typedef struct{
+    FILE *file;
+    movie_header header;
+    uint32_t keys;    //Keypad as of the last event written or applied
+    movie_event next; //Next event to replay
+    uint64_t events;
+} movie_type;
+
+uint32_t state_hash(const chip8_type *chip8);
+
+bool movie_record(movie_type *movie, const char *path, const chip8_type *chip8, const config_type *config);
+void movie_keys(movie_type *movie, const chip8_type *chip8, uint32_t keys);
+bool movie_finish(movie_type *movie, const chip8_type *chip8);
+
+bool movie_open(movie_type *movie, const char *path);
+bool movie_start(movie_type *movie, chip8_type *chip8);
+uint64_t movie_until(const movie_type *movie, const chip8_type *chip8);
+bool movie_apply(movie_type *movie, chip8_type *chip8);
+bool movie_check(movie_type *movie, const chip8_type *chip8);
+
+#endif
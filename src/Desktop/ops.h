@@ -0,0 +1,246 @@
+#ifndef OPS_H
+#define OPS_H
+
+#include "chip8.h"
+
+//Semantics of every opcode in one place. emulate(), the JIT's helper calls and the code the aot tool
+//generates all go through these, so a fix here fixes every engine
+
+//Opcode handlers, pc has already been moved past the instruction when they run
+//xorshift32, three shifts per number and the same sequence every run for a given seed. Top byte is the best mixed
+static inline uint8_t next_random(chip8_type *chip8){
+    uint32_t x = chip8->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    chip8->rng = x;
+    return x >> 24;
+}
+
+static inline void op_nop(chip8_type *chip8, const instr_type *inst){(void)chip8; (void)inst;}
+static inline void op_00E0(chip8_type *chip8, const instr_type *inst){(void)inst; memset(chip8->display, 0, sizeof(chip8->display)); chip8->draw = true;} //Clear display
+static inline void op_00EE(chip8_type *chip8, const instr_type *inst){(void)inst; chip8->pc = chip8->stack[--chip8->sp];} //Pop off current subroutine and set pc to that subroutine
+static inline void op_1NNN(chip8_type *chip8, const instr_type *inst){chip8->pc = inst->NNN;} // Jump to address NNN
+static inline void op_2NNN(chip8_type *chip8, const instr_type *inst){chip8->stack[chip8->sp++] = chip8->pc; chip8->pc = inst->NNN;}
+static inline void op_3XNN(chip8_type *chip8, const instr_type *inst){if(chip8->V[inst->X] == inst->NN){chip8->pc += 2;}} //If VX is equal to NN increment PC
+static inline void op_4XNN(chip8_type *chip8, const instr_type *inst){if(chip8->V[inst->X] != inst->NN){chip8->pc += 2;}} //If VX is not equal to NN increment PC
+static inline void op_5XY0(chip8_type *chip8, const instr_type *inst){if(chip8->V[inst->X] == chip8->V[inst->Y]){chip8->pc += 2;}} // If VX == VY increment PC
+static inline void op_6XNN(chip8_type *chip8, const instr_type *inst){chip8->V[inst->X] = inst->NN;} //Set VX = NN
+static inline void op_7XNN(chip8_type *chip8, const instr_type *inst){chip8->V[inst->X] += inst->NN;} // Increment VX by the value NN
+static inline void op_8XY0(chip8_type *chip8, const instr_type *inst){chip8->V[inst->X] = chip8->V[inst->Y];}
+static inline void op_8XY1(chip8_type *chip8, const instr_type *inst){chip8->V[inst->X] = chip8->V[inst->X] | chip8->V[inst->Y];}
+static inline void op_8XY2(chip8_type *chip8, const instr_type *inst){chip8->V[inst->X] = chip8->V[inst->X] & chip8->V[inst->Y];}
+static inline void op_8XY3(chip8_type *chip8, const instr_type *inst){chip8->V[inst->X] = chip8->V[inst->X] ^ chip8->V[inst->Y];}
+static inline void op_8XY4(chip8_type *chip8, const instr_type *inst){
+    uint16_t result = chip8->V[inst->X] + chip8->V[inst->Y];
+    chip8->V[0xF] = (result > 0xFF) ? 1 : 0;
+    chip8->V[inst->X] = (uint8_t)result;
+}
+static inline void op_8XY5(chip8_type *chip8, const instr_type *inst){
+    chip8->V[inst->X] -= chip8->V[inst->Y];
+    chip8->V[0xF] = (chip8->V[inst->X] >= chip8->V[inst->Y]) ? 1 : 0;
+}
+static inline void op_8XY6(chip8_type *chip8, const instr_type *inst){
+    chip8->V[0xF] = (chip8->V[inst->X] & 0x1);
+    chip8->V[inst->X] >>= 1;
+}
+static inline void op_8XY6_VY(chip8_type *chip8, const instr_type *inst){
+    chip8->V[0xF] = (chip8->V[inst->Y] & 0x1);
+    chip8->V[inst->X] = chip8->V[inst->Y] >> 1;
+}
+static inline void op_8XY7(chip8_type *chip8, const instr_type *inst){
+    chip8->V[inst->X] = chip8->V[inst->Y] - chip8->V[inst->X];
+    chip8->V[0xF] = (chip8->V[inst->Y] >= chip8->V[inst->X]) ? 1 : 0;
+}
+static inline void op_8XYE(chip8_type *chip8, const instr_type *inst){
+    chip8->V[0xF] = (chip8->V[inst->X] & 0x80) >> 7;
+    chip8->V[inst->X] <<= 1;
+}
+static inline void op_8XYE_VY(chip8_type *chip8, const instr_type *inst){
+    chip8->V[0xF] = (chip8->V[inst->Y] & 0x80) >> 7;
+    chip8->V[inst->X] = chip8->V[inst->Y] << 1;
+}
+static inline void op_9XY0(chip8_type *chip8, const instr_type *inst){if(chip8->V[inst->X] != chip8->V[inst->Y]){chip8->pc += 2;}}
+static inline void op_ANNN(chip8_type *chip8, const instr_type *inst){chip8->I = inst->NNN;}
+static inline void op_BNNN(chip8_type *chip8, const instr_type *inst){chip8->pc = inst->NNN + chip8->V[0];}
+static inline void op_BXNN(chip8_type *chip8, const instr_type *inst){chip8->pc = inst->NNN + chip8->V[inst->X];}
+static inline void op_CXNN(chip8_type *chip8, const instr_type *inst){chip8->V[inst->X] = next_random(chip8) & inst->NN;}
+
+//Visible part of display for the current mode, SUPER-CHIP hi-res is 128x64 and everything else 64x32
+static inline uint8_t screen_width(const chip8_type *chip8){return chip8->hires ? 128 : 64;}
+static inline uint8_t screen_height(const chip8_type *chip8){return chip8->hires ? 64 : 32;}
+
+//XOR a sprite row onto display row y with its leftmost pixel at x. bits holds the row top aligned, bit 63 lands
+//on x. Pixels past the right edge shift out of the last word, low res never touches the second one. Returns the pixels turned off
+static inline uint64_t draw_row(chip8_type *chip8, uint8_t y, uint8_t x, uint64_t bits){
+    uint64_t *row = chip8->display[y];
+    uint64_t collision = 0;
+    if(x < 64){
+        const uint64_t left = bits >> x;
+        collision = row[0] & left;
+        row[0] ^= left;
+        if(!chip8->hires || x == 0){return collision;}
+        bits <<= 64 - x; //What spilled past the first word
+    }
+    else{bits >>= x - 64;}
+    collision |= row[1] & bits;
+    row[1] ^= bits;
+    return collision;
+}
+
+static inline void op_DXYN(chip8_type *chip8, const instr_type *inst){
+     // 0xDXYN: Draw N-height sprite at coords X,Y; Read from memory location I;
+    //   Each sprite row is shifted into place and XOR'd onto its display row a word at a time, see draw_row(),
+    //   VF (Carry flag) is set if any screen pixels are set off, which is an AND of the two words.
+    //   Pixels past the right edge shift out of the word, rows past the bottom edge are not drawn.
+    const uint8_t height = screen_height(chip8);
+    const uint8_t X_coord = chip8->V[inst->X] % screen_width(chip8);
+    const uint8_t Y_coord = chip8->V[inst->Y] % height;
+    uint64_t collision = 0;
+
+    for (uint8_t i = 0; i < inst->N && Y_coord + i < height; i++) {
+        collision |= draw_row(chip8, Y_coord + i, X_coord, (uint64_t)chip8->ram[chip8->I + i] << 56);
+    }
+
+    chip8->V[0xF] = collision ? 1 : 0;
+    chip8->draw = true; // Will update screen on next 60hz tick
+}
+static inline void op_EX9E(chip8_type *chip8, const instr_type *inst){if(chip8->keypad[chip8->V[inst->X]]){chip8->pc += 2;}}
+static inline void op_EXA1(chip8_type *chip8, const instr_type *inst){if(!chip8->keypad[chip8->V[inst->X]]){chip8->pc += 2;}}
+static inline void op_FX07(chip8_type *chip8, const instr_type *inst){chip8->V[inst->X] = read_timer(chip8, chip8->delay_expires, chip8->cycles);}
+static inline void op_FX0A(chip8_type *chip8, const instr_type *inst){
+    uint8_t key_value = 0xFF;
+    bool key_pressed = false;
+    key_pressed = check_keypad(chip8, &key_value);
+
+    if(!key_pressed){chip8->pc -= 2; return;}
+    chip8->V[inst->X] = key_value;
+}
+static inline void op_FX15(chip8_type *chip8, const instr_type *inst){chip8->delay_expires = set_timer(chip8, chip8->V[inst->X]);}
+static inline void op_FX18(chip8_type *chip8, const instr_type *inst){chip8->sound_expires = set_timer(chip8, chip8->V[inst->X]);}
+static inline void op_FX1E(chip8_type *chip8, const instr_type *inst){chip8->I += chip8->V[inst->X];}
+static inline void op_FX1E_VF(chip8_type *chip8, const instr_type *inst){
+    uint32_t result = chip8->I + chip8->V[inst->X]; 
+    chip8->V[0xF] = (result > 0xFFF) ? 1 : 0;
+    chip8->I = (uint16_t)result;
+}
+static inline void op_FX29(chip8_type *chip8, const instr_type *inst){chip8->I = chip8->V[inst->X] * 5;}
+static inline void op_FX33(chip8_type *chip8, const instr_type *inst){
+    uint8_t va = chip8->V[inst->X];
+    chip8->ram[chip8->I+2] = va % 10;
+    va /= 10;
+    chip8->ram[chip8->I+1] = va % 10;
+    va /= 10;
+    chip8->ram[chip8->I] = va;
+    invalidate(chip8, chip8->I, 3); //Only FX33 and FX55 write to ram, so only they can make the cache stale
+}
+static inline void op_FX55(chip8_type *chip8, const instr_type *inst){
+    const uint8_t X = inst->X; //inst may be one of the cache entries we are about to redecode
+    for(int i = 0; i <= X; i++){chip8->ram[chip8->I+i] = chip8->V[i];}
+    invalidate(chip8, chip8->I, X + 1);
+}
+static inline void op_FX55_I(chip8_type *chip8, const instr_type *inst){
+    const uint16_t addr = chip8->I; //I moves, so remember where we wrote
+    const uint8_t X = inst->X;
+    for(int i = 0; i <= X; i++){chip8->ram[chip8->I+i] = chip8->V[i];}
+    chip8->I = X + 1;
+    invalidate(chip8, addr, X + 1);
+}
+static inline void op_FX65(chip8_type *chip8, const instr_type *inst){for(int i = 0; i <= inst->X; i++){chip8->V[i] = chip8->ram[chip8->I+i];}}
+static inline void op_FX65_I(chip8_type *chip8, const instr_type *inst){for(int i = 0; i <= inst->X; i++){chip8->V[i] = chip8->ram[chip8->I+i];} chip8->I = inst->X + 1;}
+static inline void op_F002(chip8_type *chip8, const instr_type *inst){(void)inst; for(int i = 0; i < 16; i++){chip8->pattern[i] = chip8->ram[(chip8->I + i) & 0x0FFF];}} //Load the audio pattern from I
+static inline void op_FX3A(chip8_type *chip8, const instr_type *inst){chip8->pitch = chip8->V[inst->X];}
+
+//SUPER-CHIP. Scrolls move whole rows with one memmove and columns with a shift per word, in pixels of the current mode
+static inline void op_00CN(chip8_type *chip8, const instr_type *inst){ //Scroll down N rows
+    const uint8_t height = screen_height(chip8);
+    memmove(chip8->display[inst->N], chip8->display[0], (height - inst->N) * sizeof chip8->display[0]);
+    memset(chip8->display[0], 0, inst->N * sizeof chip8->display[0]);
+    chip8->draw = true;
+}
+static inline void op_00FB(chip8_type *chip8, const instr_type *inst){ //Scroll right 4 pixels
+    (void)inst;
+    const uint8_t height = screen_height(chip8);
+    for(uint8_t y = 0; y < height; y++){
+        uint64_t *row = chip8->display[y];
+        row[1] = chip8->hires ? (row[1] >> 4) | (row[0] << 60) : 0; //Low res clips at the end of the first word
+        row[0] >>= 4;
+    }
+    chip8->draw = true;
+}
+static inline void op_00FC(chip8_type *chip8, const instr_type *inst){ //Scroll left 4 pixels
+    (void)inst;
+    const uint8_t height = screen_height(chip8);
+    for(uint8_t y = 0; y < height; y++){
+        uint64_t *row = chip8->display[y];
+        row[0] = (row[0] << 4) | (row[1] >> 60);
+        row[1] <<= 4;
+    }
+    chip8->draw = true;
+}
+static inline void op_00FD(chip8_type *chip8, const instr_type *inst){(void)inst; chip8->pc -= 2;} //Exit, there is nothing to exit to so stay here
+static inline void op_00FE(chip8_type *chip8, const instr_type *inst){chip8->hires = false; op_00E0(chip8, inst);} //Low res, the screen starts clear in a new mode
+static inline void op_00FF(chip8_type *chip8, const instr_type *inst){chip8->hires = true; op_00E0(chip8, inst);} //High res
+static inline void op_DXY0(chip8_type *chip8, const instr_type *inst){ //16x16 sprite, two bytes a row
+    const uint8_t height = screen_height(chip8);
+    const uint8_t X_coord = chip8->V[inst->X] % screen_width(chip8);
+    const uint8_t Y_coord = chip8->V[inst->Y] % height;
+    uint64_t collision = 0;
+
+    for(uint8_t i = 0; i < 16 && Y_coord + i < height; i++){
+        const uint16_t sprite_row = (chip8->ram[chip8->I + 2*i] << 8) | chip8->ram[chip8->I + 2*i + 1];
+        collision |= draw_row(chip8, Y_coord + i, X_coord, (uint64_t)sprite_row << 48);
+    }
+
+    chip8->V[0xF] = collision ? 1 : 0;
+    chip8->draw = true;
+}
+static inline void op_FX30(chip8_type *chip8, const instr_type *inst){chip8->I = BIG_FONT + chip8->V[inst->X] * 10;}
+static inline void op_FX75(chip8_type *chip8, const instr_type *inst){for(int i = 0; i <= inst->X; i++){chip8->flags[i] = chip8->V[i];}}
+static inline void op_FX85(chip8_type *chip8, const instr_type *inst){for(int i = 0; i <= inst->X; i++){chip8->V[i] = chip8->flags[i];}}
+
+//Fused pairs run both halves back to back, pc moves past the second one in between just like a second dispatch would
+static inline void op_6XNN_6XNN(chip8_type *chip8, const instr_type *inst){op_6XNN(chip8, inst); chip8->pc += 2; op_6XNN(chip8, inst + 2);}
+static inline void op_ANNN_DXYN(chip8_type *chip8, const instr_type *inst){op_ANNN(chip8, inst); chip8->pc += 2; op_DXYN(chip8, inst + 2);}
+static inline void op_7XNN_3XNN(chip8_type *chip8, const instr_type *inst){op_7XNN(chip8, inst); chip8->pc += 2; op_3XNN(chip8, inst + 2);}
+static inline void op_FX07_3XNN(chip8_type *chip8, const instr_type *inst){op_FX07(chip8, inst); chip8->pc += 2; op_3XNN(chip8, inst + 2);}
+
+//How many instructions a dispatch of op runs, idle loops excepted
+static inline int op_count(uint8_t op){return (op >= OP_6XNN_6XNN) ? 2 : 1;}
+
+//Idle loops can only be waiting on the delay timer or the keypad. The keypad never changes partway through a
+//batch and the timer's next change is known from the cycle counter, so instead of going round one trip at a
+//time take every whole trip up to the first one that would leave, and leave pc where the last one ends.
+//Comes out exactly as if each instruction had run. Returns how many instructions that was
+static inline int op_idle(chip8_type *chip8, const instr_type *inst, uint8_t op, int budget){
+    switch(op){
+        case(OP_IDLE_1NNN):{op_1NNN(chip8, inst); return budget;}
+        case(OP_IDLE_FX07):{
+            const uint8_t NN = inst[2].NN;
+            const uint8_t value = read_timer(chip8, chip8->delay_expires, chip8->cycles);
+            if(value == NN || budget < 3){ //Leaves this trip, or not enough budget for a whole one
+                if(budget < 2){op_FX07(chip8, inst); return 1;}
+                op_FX07_3XNN(chip8, inst);
+                return 2;
+            }
+
+            uint64_t trips = budget / 3;
+            if(NN < value){ //Timer counts down to NN, stop on the trip whose FX07 would read it
+                const uint64_t leave = tick_cycle(chip8, chip8->delay_expires - NN);
+                const uint64_t before = (leave - chip8->cycles + 2) / 3;
+                if(before < trips){trips = before;}
+            }
+            chip8->V[inst->X] = read_timer(chip8, chip8->delay_expires, chip8->cycles + 3 * (trips - 1)); //What the last FX07 read
+            chip8->pc -= 2; //Back on the FX07, where every trip ends
+            return (int)trips * 3;
+        }
+        case(OP_IDLE_FX0A):{
+            const uint16_t pc = chip8->pc;
+            op_FX0A(chip8, inst);
+            return (chip8->pc == pc) ? 1 : budget; //pc only moves back if there was no key to take
+        }
+    }
+    return 1;
+}
+
+#endif
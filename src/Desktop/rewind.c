@@ -0,0 +1,132 @@
+#include "rewind.h"
+
+#define MAX_ENCODED (3 * sizeof(state_type) + 4) //Every other byte changed, 5 bytes for each 2
+
+//XOR state against base (zeros if base is NULL) and code the result as [zeros u16][literals u16][literal bytes]
+//repeated until the end. Returns the encoded size
+static uint32_t delta_encode(const uint8_t *state, const uint8_t *base, uint8_t *out){
+    uint8_t *p = out;
+    size_t i = 0;
+    while(i < sizeof(state_type)){
+        uint16_t zeros = 0, literals = 0;
+        while(i < sizeof(state_type) && zeros < UINT16_MAX && (state[i] ^ (base ? base[i] : 0)) == 0){zeros++; i++;}
+
+        uint8_t *header = p;
+        p += 4;
+        while(i < sizeof(state_type) && literals < UINT16_MAX && (state[i] ^ (base ? base[i] : 0)) != 0){*p++ = state[i] ^ (base ? base[i] : 0); literals++; i++;}
+
+        memcpy(header, &zeros, 2);
+        memcpy(header + 2, &literals, 2);
+    }
+    return (uint32_t)(p - out);
+}
+
+//XOR an encoded frame back into state, which has to start out as the base it was encoded against
+static void delta_decode(const uint8_t *in, uint32_t size, uint8_t *state){
+    const uint8_t *const end = in + size;
+    size_t i = 0;
+    while(in < end){
+        uint16_t zeros, literals;
+        memcpy(&zeros, in, 2);
+        memcpy(&literals, in + 2, 2);
+        in += 4;
+        i += zeros;
+        for(uint16_t j = 0; j < literals; j++){state[i++] ^= *in++;}
+    }
+}
+
+static rewind_entry *entry(rewind_type *history, uint32_t seq){return &history->entries[seq % history->max_entries];}
+
+//Put keyframe seq in history->key so deltas against it can be encoded or decoded
+static void load_key(rewind_type *history, uint32_t seq){
+    if(history->key_valid && history->key_seq == seq){return;}
+    const rewind_entry *key = entry(history, seq);
+    memset(&history->key, 0, sizeof history->key);
+    delta_decode(&history->data[key->offset], key->size, (uint8_t *)&history->key);
+    history->key_seq = seq;
+    history->key_valid = true;
+}
+
+static void drop_oldest(rewind_type *history){
+    history->head++;
+    if(history->key_seq < history->head){history->key_valid = false;}
+}
+
+bool rewind_init(rewind_type *history, int seconds){
+    memset(history, 0, sizeof *history); //Padding in the states stays zero, so it never shows up in a delta
+    if(seconds <= 0){return false;}
+
+    history->capacity = (uint32_t)seconds * REWIND_BYTES_PER_SEC;
+    history->max_entries = (uint32_t)seconds * 60;
+    history->data = malloc(history->capacity);
+    history->entries = malloc(history->max_entries * sizeof(rewind_entry));
+    history->encoded = malloc(MAX_ENCODED);
+    if(!history->data || !history->entries || !history->encoded || history->capacity < MAX_ENCODED){rewind_free(history); return false;}
+    return true;
+}
+
+void rewind_free(rewind_type *history){
+    free(history->data);
+    free(history->entries);
+    free(history->encoded);
+    memset(history, 0, sizeof *history);
+}
+
+//Drop the oldest frames until size bytes fit at the write position, returns where they go. Past the end of
+//the ring, everything from there to the end is the oldest lap, so it goes first
+static uint32_t make_room(rewind_type *history, uint32_t size){
+    uint32_t at = history->write;
+    if(at + size > history->capacity){
+        while(history->head != history->next && entry(history, history->head)->offset >= at){drop_oldest(history);}
+        at = 0;
+    }
+    while(history->head != history->next){
+        const rewind_entry *oldest = entry(history, history->head);
+        const bool overlaps = oldest->offset < at + size && at < oldest->offset + oldest->size;
+        if(!overlaps && history->next - history->head < history->max_entries){break;}
+        drop_oldest(history);
+    }
+    while(history->head != history->next && entry(history, history->head)->key != history->head){drop_oldest(history);} //Deltas are no use without their keyframe
+    return at;
+}
+
+//Capture the frame that just ran
+void rewind_push(rewind_type *history, const chip8_type *chip8){
+    if(!history->data){return;}
+
+    save_state(chip8, &history->frame);
+    bool keyframe = !history->key_valid || history->next - history->key_seq >= REWIND_KEY_FRAMES;
+    uint32_t size = delta_encode((const uint8_t *)&history->frame, keyframe ? NULL : (const uint8_t *)&history->key, history->encoded);
+    uint32_t at = make_room(history, size);
+    if(!keyframe && !history->key_valid){
+        //Making room dropped the keyframe the delta is against, so this one has to be a keyframe instead
+        keyframe = true;
+        size = delta_encode((const uint8_t *)&history->frame, NULL, history->encoded);
+        at = make_room(history, size);
+    }
+
+    memcpy(&history->data[at], history->encoded, size);
+    *entry(history, history->next) = (rewind_entry){.offset = at, .size = size, .key = keyframe ? history->next : history->key_seq};
+    if(keyframe){
+        history->key = history->frame;
+        history->key_seq = history->next;
+        history->key_valid = true;
+    }
+    history->next++;
+    history->write = at + size;
+}
+
+//Step back to the newest frame held and forget it, false once there is no history left
+bool rewind_pop(rewind_type *history, chip8_type *chip8){
+    if(!history->data || history->head == history->next){return false;}
+
+    const uint32_t seq = --history->next;
+    const rewind_entry *newest = entry(history, seq);
+    load_key(history, newest->key);
+    history->frame = history->key;
+    if(newest->key != seq){delta_decode(&history->data[newest->offset], newest->size, (uint8_t *)&history->frame);}
+
+    history->write = newest->offset; //Newest was the last thing written, so its space is free again
+    if(history->key_seq >= history->next){history->key_valid = false;} //Popped the keyframe itself
+    return load_state(chip8, &history->frame);
+}
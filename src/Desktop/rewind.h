@@ -0,0 +1,40 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include "state.h"
+
+//Rewind history. Every frame's save state goes into a fixed size ring, but only as the bytes that differ
+//from the last keyframe: XOR against it, then the runs of zeros that leaves are run length coded. A frame
+//costs a few dozen bytes instead of a whole state. Every REWIND_KEY_FRAMES a full keyframe is stored (XOR
+//against nothing). When the ring is full the oldest frames go, along with any deltas left without their keyframe.
+
+#define REWIND_KEY_FRAMES 60     //A keyframe a second
+#define REWIND_BYTES_PER_SEC 65536 //Ring size per second of history, a minute is 4MB
+
+typedef struct{
+    uint32_t offset; //Where the encoded frame starts in data
+    uint32_t size;
+    uint32_t key;    //Sequence number of the keyframe it was XORed against, its own for a keyframe
+} rewind_entry;
+
+typedef struct{
+    uint8_t *data;        //Encoded frames, written in order and wrapping at capacity
+    uint32_t capacity;
+    uint32_t write;       //Where the next frame goes
+    rewind_entry *entries;
+    uint32_t max_entries;
+    uint32_t head;        //Sequence number of the oldest frame still held, entries[seq % max_entries]
+    uint32_t next;        //Sequence number the next frame gets
+    state_type key;       //Decoded copy of keyframe key_seq
+    uint32_t key_seq;
+    bool key_valid;
+    state_type frame;     //Scratch for the frame being captured or restored
+    uint8_t *encoded;     //Scratch big enough for the worst case encoding
+} rewind_type;
+
+bool rewind_init(rewind_type *history, int seconds);
+void rewind_free(rewind_type *history);
+void rewind_push(rewind_type *history, const chip8_type *chip8);
+bool rewind_pop(rewind_type *history, chip8_type *chip8);
+
+#endif
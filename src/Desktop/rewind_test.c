@@ -0,0 +1,131 @@
+//Rewind history test, core only with no SDL. make test
+//
+//Pushes frames that change a lot of ram each time, so the ring wraps many times over and keyframes get dropped
+//while deltas against them are still being written, then rewinds through the wrap and checks every frame it
+//gets back is exactly the one that was pushed. Also checks load_state() turns away states with sp or pc out
+//of range and leaves the machine as it was, that timers come back right at a different insts_per_sec, and that DXYN sets VF in 128x64 mode on every engine.
+
+#include "rewind.h"
+#include "jit.h"
+
+#define FRAMES 600       //Ten keyframe intervals
+#define CHANGED 1500     //Ram bytes changed per frame, a few KB a delta so a second of ring holds a few dozen frames
+
+static state_type pushed[FRAMES];
+
+static uint32_t next_random(uint32_t *x){
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+//Push frames frames, then rewind as far as history goes. Returns how many came back wrong, -1 if none came back
+static int run(int frames){
+    static config_type config = {.choice = COSMAC, .insts_per_sec = 700, .seed = 1};
+    static chip8_type chip8;
+    static rewind_type history;
+    const uint8_t program[] = {0x12, 0x00}; //Jumps to itself, nothing runs anyway
+    if(!init_chip8_program(&chip8, &config, program, sizeof program)){return -1;}
+    if(!rewind_init(&history, 1)){fprintf(stderr, "Could not allocate rewind history\n"); return -1;}
+
+    uint32_t rng = 12345;
+    for(int f = 0; f < frames; f++){
+        for(int i = 0; i < CHANGED; i++){chip8.ram[0x200 + next_random(&rng) % 0xE00] = (uint8_t)next_random(&rng);}
+        chip8.V[f % 16] = (uint8_t)f;
+        chip8.cycles += 12;
+        save_state(&chip8, &pushed[f]);
+        rewind_push(&history, &chip8);
+    }
+
+    int popped = 0, wrong = 0;
+    static state_type got;
+    for(int f = frames - 1; rewind_pop(&history, &chip8); f--, popped++){
+        memset(&got, 0, sizeof got);
+        save_state(&chip8, &got);
+        if(f < 0 || memcmp(&got, &pushed[f], sizeof got)){wrong++;}
+    }
+    rewind_free(&history);
+    return popped ? wrong : -1;
+}
+
+//Returns how many states load_state() got wrong, taking one out of range or refusing one in range
+static int load_bad_states(void){
+    static config_type config = {.choice = COSMAC, .insts_per_sec = 700, .seed = 1};
+    static chip8_type chip8;
+    static state_type before, bad, after;
+    const uint8_t program[] = {0x22, 0x04, 0x12, 0x00, 0x00, 0xEE};
+    if(!init_chip8_program(&chip8, &config, program, sizeof program)){return 1;}
+    save_state(&chip8, &before);
+
+    int wrong = 0;
+    const struct{uint8_t sp; uint16_t pc;} cases[] = {{49, 0x200}, {255, 0x200}, {0, 0xFFF}, {0, 0xFFFF}};
+    for(size_t i = 0; i < sizeof cases / sizeof cases[0]; i++){
+        bad = before;
+        bad.ram[0x300] = 0xAA; //Would show up in after if load_state() got as far as copying ram
+        bad.sp = cases[i].sp;
+        bad.pc = cases[i].pc;
+        if(load_state(&chip8, &bad)){wrong++;}
+        save_state(&chip8, &after);
+        if(memcmp(&after, &before, sizeof after)){wrong++;}
+    }
+    bad = before;
+    bad.sp = 48; //Full stack is fine
+    bad.pc = 0xFFE;
+    if(!load_state(&chip8, &bad)){wrong++;}
+    return wrong;
+}
+
+//Saves with the timers running at 700 instructions a second and loads at 7000. Returns how many timers came back wrong
+static int load_other_ips(void){
+    static config_type slow = {.choice = COSMAC, .insts_per_sec = 700, .seed = 1};
+    static config_type fast = {.choice = COSMAC, .insts_per_sec = 7000, .seed = 1};
+    static chip8_type chip8;
+    static state_type state;
+    const uint8_t program[] = {0x60, 0xC8, 0xF0, 0x15, 0xF0, 0x18, 0x12, 0x06}; //Both timers to 200
+    if(!init_chip8_program(&chip8, &slow, program, sizeof program)){return 1;}
+    chip8.cycles = 70000; //A hundred seconds in, far enough that ticks at the two rates are thousands apart
+    run_switch(&chip8, 3);
+    save_state(&chip8, &state);
+    if(!init_chip8_program(&chip8, &fast, program, sizeof program)){return 1;}
+    if(!load_state(&chip8, &state)){return 1;}
+    return (read_timer(&chip8, chip8.delay_expires, chip8.cycles) != 200) + (read_timer(&chip8, chip8.sound_expires, chip8.cycles) != 200);
+}
+
+//Draws the same one row sprite twice in 128x64 mode, on each engine and either side of the word boundary.
+//Returns how many runs left VF clear
+static int draw_collisions(void){
+    const dispatch_type engines[] = {SWITCH, TABLE, THREADED, JIT};
+    const uint8_t xs[] = {5, 60, 100};
+    int wrong = 0;
+    for(size_t e = 0; e < sizeof engines / sizeof engines[0]; e++){
+        for(size_t i = 0; i < sizeof xs; i++){
+            static config_type config = {.choice = SCHIP, .insts_per_sec = 700, .seed = 1};
+            static chip8_type chip8;
+            config.dispatch = engines[e];
+            //00FF, V0 = x, I = sprite, D001 twice, then jump to itself
+            const uint8_t program[] = {0x00, 0xFF, 0x60, xs[i], 0xA2, 0x0C, 0xD0, 0x01, 0xD0, 0x01, 0x12, 0x0A, 0xFF};
+            if(!init_chip8_program(&chip8, &config, program, sizeof program)){return 1;}
+            const engine_type engine = select_engine(&chip8, &config);
+            engine(&chip8, 6);
+            if(chip8.V[0xF] != 1){wrong++;}
+            jit_destroy(chip8.jit);
+        }
+    }
+    return wrong;
+}
+
+int main(void){
+    if(load_bad_states()){printf("load_state got sp or pc range checks wrong\nFAIL\n"); return EXIT_FAILURE;}
+    if(load_other_ips()){printf("Timers came back wrong from a state saved at another insts_per_sec\nFAIL\n"); return EXIT_FAILURE;}
+    if(draw_collisions()){printf("DXYN missed a collision in 128x64 mode\nFAIL\n"); return EXIT_FAILURE;}
+
+    //Stop at every frame of the last keyframe interval, a frame is most likely to be wrong when it is the newest
+    int failed = 0;
+    for(int frames = FRAMES - REWIND_KEY_FRAMES; frames <= FRAMES; frames++){
+        const int wrong = run(frames);
+        if(wrong){printf("%d frames pushed: %s\n", frames, wrong < 0 ? "nothing to rewind" : "rewound into the wrong state"); failed++;}
+    }
+    printf("%s\n", failed ? "FAIL" : "PASS");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,49 @@
+#include "sched.h"
+
+#define SCHED_MAX_BEHIND 4 //Frames we will run back to back to catch up before giving the time up as lost
+
+//Instructions frames 0 to frame-1 add up to
+static uint64_t insts_before(const sched_type *sched, uint64_t frame){
+    return frame * sched->ips / sched->hz;
+}
+
+void sched_init(sched_type *sched, int ips, int hz, uint64_t now, uint64_t freq){
+    *sched = (sched_type){.ips = ips, .hz = hz, .freq = freq, .base = now, .window_start = now};
+}
+
+//Instructions the current frame should run, the remainders carry so the total is exact
+int sched_frame_insts(const sched_type *sched){
+    return (int)(insts_before(sched, sched->frame + 1) - insts_before(sched, sched->frame));
+}
+
+//Counter value the current frame is due to start at
+uint64_t sched_deadline(const sched_type *sched){
+    return sched->base + (sched->frame - sched->base_frame) * sched->freq / sched->hz;
+}
+
+//Start counting deadlines from now, after a pause nothing was missed so nothing counts as dropped
+void sched_resync(sched_type *sched, uint64_t now){
+    sched->base = now;
+    sched->base_frame = sched->frame;
+}
+
+//ran is what the frame actually ran, 0 for a rewind frame, so measured_ips is emulation alone
+void sched_end_frame(sched_type *sched, uint64_t now, int ran){
+    sched->window_insts += ran;
+    sched->frame++;
+
+    //Too far behind (debugger, machine asleep), start counting deadlines from now instead of bursting
+    if(now > sched_deadline(sched) + SCHED_MAX_BEHIND * sched->freq / sched->hz){
+        sched->dropped += (now - sched_deadline(sched)) * sched->hz / sched->freq;
+        sched_resync(sched, now);
+    }
+
+    if(now - sched->window_start >= sched->freq){
+        const double seconds = (double)(now - sched->window_start) / sched->freq;
+        sched->measured_ips = sched->window_insts / seconds;
+        sched->measured_fps = (sched->frame - sched->window_frame) / seconds;
+        sched->window_start = now;
+        sched->window_frame = sched->frame;
+        sched->window_insts = 0;
+    }
+}
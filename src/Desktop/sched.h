@@ -0,0 +1,34 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+
+//Frame scheduler that keeps count in emulated instructions and absolute deadlines, so nothing drifts.
+//Frame f runs (f+1)*ips/hz - f*ips/hz instructions, which adds up to exactly ips every second even
+//when ips doesn't divide by hz, and frame f is due at start + f*freq/hz rather than "16.67ms after the
+//last one". Counter values are passed in so the same code paces the window and the headless modes.
+
+typedef struct{
+    int ips;            //Target instructions per second
+    int hz;             //Target frames per second
+    uint64_t freq;      //Counter ticks per second
+    uint64_t base;      //Counter value base_frame was due at
+    uint64_t base_frame;
+    uint64_t frame;     //Frames run so far
+    uint64_t dropped;   //Frames given up on because we fell too far behind to catch up
+
+    //Measured over the last second or so
+    uint64_t window_start;
+    uint64_t window_frame;
+    uint64_t window_insts;
+    double measured_ips;
+    double measured_fps;
+} sched_type;
+
+void sched_init(sched_type *sched, int ips, int hz, uint64_t now, uint64_t freq);
+int sched_frame_insts(const sched_type *sched);
+uint64_t sched_deadline(const sched_type *sched);
+void sched_end_frame(sched_type *sched, uint64_t now, int ran);
+void sched_resync(sched_type *sched, uint64_t now);
+
+#endif
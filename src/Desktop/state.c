@@ -0,0 +1,72 @@
+#include "state.h"
+
+void save_state(const chip8_type *chip8, state_type *state){
+    state->magic = STATE_MAGIC;
+    state->version = STATE_VERSION;
+    state->cycles = chip8->cycles;
+    memcpy(state->display, chip8->display, sizeof state->display);
+    memcpy(state->ram, chip8->ram, sizeof state->ram);
+    memcpy(state->stack, chip8->stack, sizeof state->stack);
+    state->I = chip8->I;
+    state->pc = chip8->pc;
+    state->rng = chip8->rng;
+    memcpy(state->V, chip8->V, sizeof state->V);
+    state->sp = chip8->sp;
+    state->delay_timer = read_timer(chip8, chip8->delay_expires, chip8->cycles);
+    state->sound_timer = read_timer(chip8, chip8->sound_expires, chip8->cycles);
+    state->pitch = chip8->pitch;
+    memcpy(state->pattern, chip8->pattern, sizeof state->pattern);
+    memcpy(state->flags, chip8->flags, sizeof state->flags);
+    state->hires = chip8->hires;
+    state->quirks = *chip8->quirks;
+}
+
+bool load_state(chip8_type *chip8, const state_type *state){
+    if(state->magic != STATE_MAGIC || state->version != STATE_VERSION){fprintf(stderr, "Not a version %d save state\n", STATE_VERSION); return false;}
+    if(memcmp(&state->quirks, chip8->quirks, sizeof state->quirks)){fprintf(stderr, "Save state is for a different emulator_type\n"); return false;}
+    //A corrupt file could otherwise send 00EE/2NNN outside the stack or fetches past the end of ram
+    if(state->sp > sizeof chip8->stack / sizeof chip8->stack[0] || state->pc > 0xFFE){fprintf(stderr, "Save state has sp or pc out of range\n"); return false;}
+
+    //Only runs of bytes that changed go through invalidate(), so loading a state of the same game
+    //keeps nearly all of the decode cache and compiled blocks
+    for(uint16_t addr = 0; addr < sizeof chip8->ram;){
+        if(chip8->ram[addr] == state->ram[addr]){addr++; continue;}
+        const uint16_t start = addr;
+        while(addr < sizeof chip8->ram && chip8->ram[addr] != state->ram[addr]){addr++;}
+        memcpy(&chip8->ram[start], &state->ram[start], addr - start);
+        invalidate(chip8, start, addr - start);
+    }
+
+    chip8->cycles = state->cycles;
+    chip8->delay_expires = set_timer(chip8, state->delay_timer); //Same tick as before at the same insts_per_sec
+    chip8->sound_expires = set_timer(chip8, state->sound_timer);
+    memcpy(chip8->display, state->display, sizeof chip8->display);
+    memcpy(chip8->stack, state->stack, sizeof chip8->stack);
+    chip8->I = state->I;
+    chip8->pc = state->pc;
+    chip8->rng = state->rng;
+    memcpy(chip8->V, state->V, sizeof chip8->V);
+    chip8->sp = state->sp;
+    chip8->pitch = state->pitch;
+    memcpy(chip8->pattern, state->pattern, sizeof chip8->pattern);
+    memcpy(chip8->flags, state->flags, sizeof chip8->flags);
+    chip8->hires = state->hires;
+    chip8->draw = true; //Screen needs to show the loaded display even if nothing draws
+    return true;
+}
+
+bool write_state(const state_type *state, const char *path){
+    FILE *file = fopen(path, "wb");
+    if(!file){fprintf(stderr, "Could not open %s for writing\n", path); return false;}
+    const bool written = fwrite(state, sizeof *state, 1, file) == 1;
+    return (fclose(file) == 0) && written;
+}
+
+bool read_state(state_type *state, const char *path){
+    FILE *file = fopen(path, "rb");
+    if(!file){fprintf(stderr, "Could not open save state %s\n", path); return false;}
+    const bool read = fread(state, sizeof *state, 1, file) == 1;
+    fclose(file);
+    if(!read){fprintf(stderr, "Save state %s is too short\n", path);}
+    return read;
+}
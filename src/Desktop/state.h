@@ -0,0 +1,39 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include "chip8.h"
+
+//Save states. Everything that makes up a running machine and nothing that can be worked out from it
+//(the decode cache, compiled code) in one flat block with no pointers, so a save is one copy and one
+//write. Bump STATE_VERSION whenever the layout changes, load_state() refuses anything else.
+
+#define STATE_MAGIC 0x38504843u //"CHP8" read as a little endian word
+#define STATE_VERSION 5
+
+typedef struct{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t cycles;
+    uint64_t display[64][2];
+    uint8_t ram[4096];
+    uint16_t stack[48];
+    uint16_t I;
+    uint16_t pc;
+    uint32_t rng;
+    uint8_t V[16];
+    uint8_t sp;
+    uint8_t delay_timer; //Timers as they read, not the tick they run out on, which depends on the insts_per_sec it was saved at
+    uint8_t sound_timer;
+    uint8_t pitch;
+    uint8_t pattern[16];
+    uint8_t flags[16];
+    bool hires;
+    quirks_type quirks; //Same ram decodes differently under another emulator_type, so only load under the one it was saved with
+} state_type;
+
+void save_state(const chip8_type *chip8, state_type *state);
+bool load_state(chip8_type *chip8, const state_type *state);
+bool write_state(const state_type *state, const char *path);
+bool read_state(state_type *state, const char *path);
+
+#endif
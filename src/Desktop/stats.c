@@ -0,0 +1,72 @@
+#include "stats.h"
+
+void histogram_add(histogram_type *hist, uint64_t us){
+    const uint64_t bucket = us / STATS_BUCKET_US;
+    hist->buckets[bucket < STATS_BUCKETS ? bucket : STATS_BUCKETS - 1]++;
+    hist->count++;
+    hist->sum_us += us;
+    if(us > hist->max_us){hist->max_us = us;}
+}
+
+//Upper edge of the bucket the percent'th sample falls in, 0 with no samples
+uint64_t histogram_percentile(const histogram_type *hist, int percent){
+    if(!hist->count){return 0;}
+    const uint64_t rank = (hist->count * percent + 99) / 100; //1 based, rounded up so p100 is the last sample
+    uint64_t seen = 0;
+    for(int i = 0; i < STATS_BUCKETS; i++){
+        seen += hist->buckets[i];
+        if(seen >= rank){return (uint64_t)(i + 1) * STATS_BUCKET_US;}
+    }
+    return hist->max_us;
+}
+
+//Start a new window once the HUD has taken its numbers
+void histogram_clear(histogram_type *hist){
+    memset(hist, 0, sizeof *hist);
+}
+
+void stats_init(stats_type *stats, uint64_t freq){
+    memset(stats, 0, sizeof *stats);
+    stats->freq = freq;
+}
+
+//Emulation frame starting at counter start, which was due at deadline
+void stats_frame(stats_type *stats, uint64_t start, uint64_t deadline){
+    if(start > deadline + stats->freq / 120){stats->late++; stats->window_late++;}
+}
+
+//Frame the emulation thread published at cycles went on screen at counter now. Only frames a few emulated
+//frames apart make a frame time, a longer gap means the game wasn't drawing and going backwards is a rewind
+void stats_present(stats_type *stats, uint64_t cycles, uint64_t frame_insts, uint64_t now){
+    if(stats->last_present && cycles == stats->last_cycles){return;} //Same frame shown again for the HUD or a resize
+    if(stats->last_present && cycles > stats->last_cycles && cycles - stats->last_cycles <= STATS_MAX_GAP * frame_insts){
+        const uint64_t us = (now - stats->last_present) * 1000000 / stats->freq;
+        histogram_add(&stats->frames, us);
+        histogram_add(&stats->window_frames, us);
+    }
+    stats->last_present = now;
+    stats->last_cycles = cycles;
+}
+
+//Time spent paused isn't a frame time, the next present starts a fresh interval. SDL thread only
+void stats_break(stats_type *stats){
+    stats->last_present = 0;
+}
+
+//Key event at counter event was first seen by the batch starting at seen
+void stats_latency(stats_type *stats, uint64_t event, uint64_t seen){
+    const uint64_t us = seen > event ? (seen - event) * 1000000 / stats->freq : 0;
+    histogram_add(&stats->latency, us);
+    histogram_add(&stats->window_latency, us);
+}
+
+void stats_summary(const stats_type *stats, uint64_t dropped, FILE *out){
+    const histogram_type *f = &stats->frames, *l = &stats->latency;
+    fprintf(out, "Present to present: %llu frames, p50 %.1f ms, p95 %.1f ms, p99 %.1f ms, max %.1f ms, %llu late, %llu dropped\n",
+        (unsigned long long)f->count, histogram_percentile(f, 50) / 1000.0, histogram_percentile(f, 95) / 1000.0,
+        histogram_percentile(f, 99) / 1000.0, f->max_us / 1000.0, (unsigned long long)stats->late, (unsigned long long)dropped);
+    if(l->count){
+        fprintf(out, "Input latency: %llu keys, mean %.1f ms, p95 %.1f ms, max %.1f ms\n", (unsigned long long)l->count,
+            l->sum_us / 1000.0 / l->count, histogram_percentile(l, 95) / 1000.0, l->max_us / 1000.0);
+    }
+}
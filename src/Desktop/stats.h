@@ -0,0 +1,52 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+//Frame pacing and input latency statistics for the HUD and the summary printed on quit. Times go into
+//fixed bucket histograms, so adding a sample is an increment and percentiles cost one walk of the buckets.
+//Frame times are measured where the player sees them, present to present on the SDL thread. Lateness and
+//input latency are measured on the emulation thread. Each thread only touches its own fields.
+
+#define STATS_BUCKET_US 100 //Histogram resolution
+#define STATS_BUCKETS 1000  //Covers 100ms, anything longer lands in the last bucket
+#define STATS_MAX_GAP 4     //Emulated frames between two presents before the game counts as not drawing rather than slow
+
+typedef struct{
+    uint32_t buckets[STATS_BUCKETS];
+    uint64_t count;
+    uint64_t sum_us;
+    uint64_t max_us;
+} histogram_type;
+
+typedef struct{
+    uint64_t freq;
+
+    //SDL thread
+    uint64_t last_present;        //Counter the previous frame was presented at, 0 when there isn't one to measure from
+    uint64_t last_cycles;         //Emulated instruction count that frame was published at
+    histogram_type frames;        //Present to present time, microseconds
+    histogram_type window_frames; //Same again since the HUD was last updated
+
+    //Emulation thread
+    histogram_type latency;       //Key event to the start of the first batch that saw it, microseconds
+    histogram_type window_latency;
+    uint64_t late;                //Frames that started more than half a frame after their deadline
+    uint64_t window_late;         //Same again since the HUD was last updated
+    uint64_t window_dropped;      //Scheduler's dropped count when the HUD was last updated, it only keeps a total
+} stats_type;
+
+void histogram_add(histogram_type *hist, uint64_t us);
+uint64_t histogram_percentile(const histogram_type *hist, int percent);
+void histogram_clear(histogram_type *hist);
+
+void stats_init(stats_type *stats, uint64_t freq);
+void stats_frame(stats_type *stats, uint64_t start, uint64_t deadline);
+void stats_present(stats_type *stats, uint64_t cycles, uint64_t frame_insts, uint64_t now);
+void stats_break(stats_type *stats);
+void stats_latency(stats_type *stats, uint64_t event, uint64_t seen);
+void stats_summary(const stats_type *stats, uint64_t dropped, FILE *out);
+
+#endif
@@ -0,0 +1,58 @@
+#include "trace.h"
+
+bool trace_open(trace_type *trace, const char *path, const char *const thread_names[TRACE_THREADS], uint64_t start, uint64_t freq){
+    trace->file = fopen(path, "w");
+    if(!trace->file){fprintf(stderr, "Could not open %s for writing\n", path); return false;}
+    trace->start = start;
+    trace->freq = freq;
+
+    fprintf(trace->file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    for(int t = 0; t < TRACE_THREADS; t++){
+        atomic_init(&trace->rings[t].head, 0);
+        atomic_init(&trace->rings[t].tail, 0);
+        atomic_init(&trace->rings[t].dropped, 0);
+        trace->rings[t].thread_name = thread_names[t];
+        fprintf(trace->file, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}", t ? "," : "", t + 1, thread_names[t]);
+    }
+    return true;
+}
+
+//Owning thread only. Never blocks, drops the event if the writer has fallen a whole ring behind
+void trace_push(trace_ring *ring, const char *name, uint64_t begin, uint64_t end){
+    const unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if(head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= TRACE_RING){
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    ring->events[head & (TRACE_RING - 1)] = (trace_event){.name = name, .begin = begin, .end = end};
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release); //Event is visible before the new head
+}
+
+//Writer thread only. Writes out everything pushed so far as complete ("X") events in microseconds
+void trace_flush(trace_type *trace){
+    const double us = 1e6 / trace->freq;
+    for(int t = 0; t < TRACE_THREADS; t++){
+        trace_ring *ring = &trace->rings[t];
+        const unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        for(; tail != head; tail++){
+            const trace_event *event = &ring->events[tail & (TRACE_RING - 1)];
+            fprintf(trace->file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                event->name, t + 1, (event->begin - trace->start) * us, (event->end - event->begin) * us);
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release); //Slots are free to reuse once written
+    }
+    fflush(trace->file);
+}
+
+//Once every thread has stopped pushing
+void trace_close(trace_type *trace){
+    trace_flush(trace);
+    fprintf(trace->file, "\n]}\n");
+    for(int t = 0; t < TRACE_THREADS; t++){
+        const unsigned int dropped = atomic_load(&trace->rings[t].dropped);
+        if(dropped){fprintf(stderr, "Trace dropped %u %s events, the writer fell behind\n", dropped, trace->rings[t].thread_name);}
+    }
+    fclose(trace->file);
+    trace->file = NULL;
+}
@@ -0,0 +1,43 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+//Frame phase tracer, writes Chrome trace event JSON (chrome://tracing, ui.perfetto.dev).
+//Each thread that traces owns one ring and only ever pushes onto it, a writer thread drains every
+//ring to the file. Single producer, single consumer, so a push is two loads and a store with no lock,
+//and the file is never touched from a thread that has a frame to finish. A full ring drops the event.
+
+#define TRACE_RING 8192 //Events per thread between flushes, a power of 2
+#define TRACE_THREADS 2
+
+typedef struct{
+    const char *name; //String literal, only the pointer is stored
+    uint64_t begin;   //Performance counter ticks
+    uint64_t end;
+} trace_event;
+
+typedef struct{
+    trace_event events[TRACE_RING];
+    atomic_uint head; //Next slot to push into, only the owning thread writes it
+    atomic_uint tail; //Next slot to write out, only the writer thread writes it
+    atomic_uint dropped;
+    const char *thread_name;
+} trace_ring;
+
+typedef struct{
+    FILE *file;
+    uint64_t start; //Counter at trace_open(), timestamps are written relative to it
+    uint64_t freq;
+    trace_ring rings[TRACE_THREADS];
+} trace_type;
+
+bool trace_open(trace_type *trace, const char *path, const char *const thread_names[TRACE_THREADS], uint64_t start, uint64_t freq);
+void trace_push(trace_ring *ring, const char *name, uint64_t begin, uint64_t end);
+void trace_flush(trace_type *trace);
+void trace_close(trace_type *trace);
+
+#endif
@@ -66,8 +66,31 @@ constexpr uint8_t font[] = {
 typedef enum{
     COSMAC,
     AMIGA, 
+    SCHIP,
 }emu_type;
 
+//Quirk policies for emulate<>, behaviour that differs between interpreters
+struct CosmacQuirks{
+    static constexpr bool shift_vy = true;      //8XY6/8XYE shift VY into VX instead of shifting VX in place
+    static constexpr bool jump_vx = false;      //BNNN jumps to XNN + VX instead of NNN + V0
+    static constexpr bool index_carry = false;  //FX1E sets VF when I goes past 0xFFF
+    static constexpr bool load_store_i = true;  //FX55/FX65 leave I at X + 1
+};
+
+struct AmigaQuirks{
+    static constexpr bool shift_vy = false;
+    static constexpr bool jump_vx = true;
+    static constexpr bool index_carry = true;
+    static constexpr bool load_store_i = false;
+};
+
+struct SchipQuirks{
+    static constexpr bool shift_vy = false;
+    static constexpr bool jump_vx = true;
+    static constexpr bool index_carry = false;
+    static constexpr bool load_store_i = false;
+};
+
 typedef enum{
     BLITZ,
     BREAKOUT,
@@ -108,6 +131,45 @@ typedef union{
     uint8_t data[2];
 } opcode_t;
 
+//Handler an instruction is predecoded to, named after the opcode it implements
+typedef enum{
+    OP_NOP, //Unknown opcodes (and 0NNN) do nothing
+    OP_00E0,
+    OP_00EE,
+    OP_1NNN,
+    OP_2NNN,
+    OP_3XNN,
+    OP_4XNN,
+    OP_5XY0,
+    OP_6XNN,
+    OP_7XNN,
+    OP_8XY0,
+    OP_8XY1,
+    OP_8XY2,
+    OP_8XY3,
+    OP_8XY4,
+    OP_8XY5,
+    OP_8XY6,
+    OP_8XY7,
+    OP_8XYE,
+    OP_9XY0,
+    OP_ANNN,
+    OP_BNNN,
+    OP_CXNN,
+    OP_DXYN,
+    OP_EX9E,
+    OP_EXA1,
+    OP_FX07,
+    OP_FX0A,
+    OP_FX15,
+    OP_FX18,
+    OP_FX1E,
+    OP_FX29,
+    OP_FX33,
+    OP_FX55,
+    OP_FX65,
+} op_type;
+
 typedef struct{
     opcode_t opcode;
     uint16_t NNN;   //Constants in instruction set, declaring like this would decrease space complexity
@@ -115,25 +177,46 @@ typedef struct{
     uint8_t N;      
     uint8_t X;      
     uint8_t Y;      
+    uint8_t op;     //Predecoded handler, see op_type
 } instr_type;
 
 //Chip 8 object
 typedef struct{
     emu_state state;
     uint8_t ram[4096]; //Ram for the chip 8
-    bool display[64*32]; //Decided to have seperate arrays for display instead of a pointer to ram. May change if I move onto super chip
+    uint64_t display[32]; //One word per row, bit 63 is x = 0. 256 bytes instead of 2K of bools
     uint16_t stack[48]; 
-    uint16_t *stkptr;
+    uint8_t sp; //Next free slot in stack, an index rather than a pointer so the whole state can be copied
     uint8_t V[16]; //Registers from V0-Vf
     uint16_t I; //Index Register  
     uint16_t pc;
     uint8_t delay_timer;
     uint8_t sound_timer; //60Hz timers in chip 8
     bool keypad[16]; //Check if keypad is in off or on state
-    instr_type inst;
+    instr_type cache[4096]; //Predecoded instruction starting at every address in ram, so emulate() never has to fetch or decode
     bool draw;
+    uint32_t rng; //xorshift32 state for CXNN, never 0
 } chip8_type;
 
+//Save state, everything that makes up a running game in one flat block with no pointers. Nothing
+//derived like the decode cache goes in. Bump STATE_VERSION whenever the layout changes
+#define STATE_VERSION 1
+
+typedef struct{
+    uint32_t version;
+    rom rom_choice; //Only loads into the game it was saved from
+    uint64_t display[32];
+    uint8_t ram[4096];
+    uint16_t stack[48];
+    uint16_t I;
+    uint16_t pc;
+    uint32_t rng;
+    uint8_t V[16];
+    uint8_t sp;
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+} state_type;
+
 typedef enum{
     MAIN,
     PAUSE,
@@ -142,7 +225,8 @@ typedef enum{
     AUDIO,
     EMU,
     GAME,
-    HOW
+    HOW,
+    STATES,
 
 }menu_type;
 
@@ -152,6 +236,7 @@ void main_screen(config_type* config, chip8_type *chip8);
 void settings_screen(menu_type menu, config_type *config, chip8_type *chip8);
 void button_input(bool* select);
 void game_select_screen(config_type *config, chip8_type* chip8);
+void pause_screen(config_type* config, chip8_type* chip8);
 
 void init_config(config_type *config){
     config->emu_choice = AMIGA;
@@ -192,7 +277,7 @@ void init_chip8(chip8_type *chip8, const config_type* config){
 
     chip8->pc = entry;
     chip8->state = OFF;
-    chip8->stkptr = &chip8->stack[0];
+    chip8->sp = 0;
 
    
 
@@ -212,7 +297,86 @@ void reset(chip8_type *chip8){
     chip8->draw = false;
     chip8->pc = entry;
     chip8->state = RUNNING;
-    chip8->stkptr = &chip8->stack[0];
+    chip8->sp = 0;
+}
+
+//Decode the instruction starting at addr into the cache
+void decode(chip8_type *chip8, uint16_t addr){
+    instr_type *inst = &chip8->cache[addr];
+
+    //Have to or 2 bytes as one opcode is 2 bytes long, the last address wraps so we never read past ram
+    inst->opcode.data[0] = chip8->ram[(addr+1) & 0x0FFF];
+    inst->opcode.data[1] = chip8->ram[addr];
+
+    inst->NNN = inst->opcode.full_op & 0x0FFF; // Immediate Memory address, we want to mask of the last 3 nibbles
+    inst->NN = inst->opcode.full_op & 0x0FF; // 8bit immediate number 
+    inst->N = inst->opcode.full_op & 0x0F; //N nibble 
+    inst->X = (inst->opcode.full_op >> 8) & 0x0F; // X register 
+    inst->Y = (inst->opcode.full_op >> 4) & 0x0F; // Y register
+
+    inst->op = OP_NOP;
+
+    switch((inst->opcode.full_op & 0xF000) >> 12){ //Masks opcode so we only get 0xA000 where A is our Opcode
+        case(0x0):{
+            switch(inst->NN){
+                case(0xE0):{inst->op = OP_00E0; break;}
+                case(0xEE):{inst->op = OP_00EE; break;}
+            }
+            break;
+        }
+        case(0x1):{inst->op = OP_1NNN; break;}
+        case(0x2):{inst->op = OP_2NNN; break;}
+        case(0x3):{inst->op = OP_3XNN; break;}
+        case(0x4):{inst->op = OP_4XNN; break;}
+        case(0x5):{inst->op = OP_5XY0; break;}
+        case(0x6):{inst->op = OP_6XNN; break;}
+        case(0x7):{inst->op = OP_7XNN; break;}
+        case(0x8):{
+            switch(inst->N){
+                case(0x0):{inst->op = OP_8XY0; break;}
+                case(0x1):{inst->op = OP_8XY1; break;}
+                case(0x2):{inst->op = OP_8XY2; break;}
+                case(0x3):{inst->op = OP_8XY3; break;}
+                case(0x4):{inst->op = OP_8XY4; break;}
+                case(0x5):{inst->op = OP_8XY5; break;}
+                case(0x6):{inst->op = OP_8XY6; break;}
+                case(0x7):{inst->op = OP_8XY7; break;}
+                case(0xE):{inst->op = OP_8XYE; break;}
+            }
+            break;
+        }
+        case(0x9):{inst->op = OP_9XY0; break;}
+        case(0xA):{inst->op = OP_ANNN; break;}
+        case(0xB):{inst->op = OP_BNNN; break;}
+        case(0xC):{inst->op = OP_CXNN; break;}
+        case(0xD):{inst->op = OP_DXYN; break;}
+        case(0xE):{
+            switch(inst->NN){
+                case(0x9E):{inst->op = OP_EX9E; break;}
+                case(0xA1):{inst->op = OP_EXA1; break;}
+            }
+            break;
+        }
+        case(0xF):{
+            switch(inst->NN){
+                case(0x07):{inst->op = OP_FX07; break;}
+                case(0x0A):{inst->op = OP_FX0A; break;}
+                case(0x15):{inst->op = OP_FX15; break;}
+                case(0x18):{inst->op = OP_FX18; break;}
+                case(0x1E):{inst->op = OP_FX1E; break;}
+                case(0x29):{inst->op = OP_FX29; break;}
+                case(0x33):{inst->op = OP_FX33; break;}
+                case(0x55):{inst->op = OP_FX55; break;}
+                case(0x65):{inst->op = OP_FX65; break;}
+            }
+            break;
+        }
+    }
+}
+
+//Ram from addr to addr+len was written to, redecode every instruction that overlaps it
+void invalidate(chip8_type *chip8, uint16_t addr, uint16_t len){
+    for(uint16_t i = 0; i <= len; i++){decode(chip8, (addr + i - 1) & 0x0FFF);} //Instruction starting one byte before addr also reads from it
 }
 
 void game_set(config_type *config, chip8_type* chip8){
@@ -225,212 +389,218 @@ void game_set(config_type *config, chip8_type* chip8){
         case(TETRIS):{memcpy(chip8->ram + entry, tetris_data, sizeof(tetris_data)); break;}
         case(MERLIN):{memcpy(chip8->ram + entry, merlin_data, sizeof(merlin_data)); break;}
     }
+    for(uint16_t addr = 0; addr < sizeof chip8->ram; addr++){decode(chip8, addr);} //Decode the whole ram once so emulate() only has to look up the cache
+    chip8->rng = static_cast<uint32_t>(Kernel::Clock::now().time_since_epoch().count()) | 1; //No RTC, so ms since boot, which depends on when the game was picked
     chip8->state = RUNNING;
 }
 
+state_type saved_state; //One slot, kept in RAM until the board is reset
+bool has_state = false;
+
+void save_state(const chip8_type *chip8, const config_type *config, state_type *state){
+    state->version = STATE_VERSION;
+    state->rom_choice = config->rom_choice;
+    memcpy(state->display, chip8->display, sizeof(state->display));
+    memcpy(state->ram, chip8->ram, sizeof(state->ram));
+    memcpy(state->stack, chip8->stack, sizeof(state->stack));
+    state->I = chip8->I;
+    state->pc = chip8->pc;
+    state->rng = chip8->rng;
+    memcpy(state->V, chip8->V, sizeof(state->V));
+    state->sp = chip8->sp;
+    state->delay_timer = chip8->delay_timer;
+    state->sound_timer = chip8->sound_timer;
+}
+
+bool load_state(chip8_type *chip8, const config_type *config, const state_type *state){
+    if(state->version != STATE_VERSION || state->rom_choice != config->rom_choice){return false;}
+    if(state->sp > sizeof(chip8->stack) / sizeof(chip8->stack[0]) || state->pc > 0xFFE){return false;} //Corrupt, 00EE/2NNN or the next fetch would run off the end
+
+    //Only runs of bytes that changed get redecoded
+    for(uint16_t addr = 0; addr < sizeof(chip8->ram);){
+        if(chip8->ram[addr] == state->ram[addr]){addr++; continue;}
+        const uint16_t start = addr;
+        while(addr < sizeof(chip8->ram) && chip8->ram[addr] != state->ram[addr]){addr++;}
+        memcpy(&chip8->ram[start], &state->ram[start], addr - start);
+        invalidate(chip8, start, addr - start);
+    }
+
+    memcpy(chip8->display, state->display, sizeof(chip8->display));
+    memcpy(chip8->stack, state->stack, sizeof(chip8->stack));
+    chip8->I = state->I;
+    chip8->pc = state->pc;
+    chip8->rng = state->rng;
+    memcpy(chip8->V, state->V, sizeof(chip8->V));
+    chip8->sp = state->sp;
+    chip8->delay_timer = state->delay_timer;
+    chip8->sound_timer = state->sound_timer;
+    chip8->draw = true;
+    return true;
+}
+
 bool check_keypad(chip8_type *chip8, uint8_t *key_value){
     for(uint8_t i = 0; i < 16 && *key_value == 0xFF ; i++){if(chip8->keypad[i]){*key_value = i; return true;}}
     return false;
 }
 
-void emulate(chip8_type *chip8, config_type *config){
+//xorshift32, three shifts per number instead of srand()/rand() every time. Top byte is the best mixed
+static inline uint8_t next_random(chip8_type *chip8){
+    uint32_t x = chip8->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    chip8->rng = x;
+    return x >> 24;
+}
 
+//Instantiated once per quirk policy, the if(Quirks::...) checks fold away at compile time
+template <typename Quirks>
+void emulate(chip8_type *chip8){
 
-    chip8->inst.opcode.data[0] = chip8->ram[chip8->pc+1];
-    chip8->inst.opcode.data[1] = chip8->ram[chip8->pc];
+    //Instruction was fetched and decoded when it was loaded into ram
+    const instr_type *inst = &chip8->cache[chip8->pc & 0x0FFF];
 
     chip8->pc += 2;
 
-    chip8->inst.NNN = chip8->inst.opcode.full_op & 0x0FFF; // Immediate Memory address
-    chip8->inst.NN = chip8->inst.opcode.full_op & 0x0FF; // 8bit immediate number 
-    chip8->inst.N = chip8->inst.opcode.full_op & 0x0F; //N nibble 
-    chip8->inst.X = (chip8->inst.opcode.full_op >> 8) & 0x0F; // X register 
-    chip8->inst.Y = (chip8->inst.opcode.full_op >> 4) & 0x0F; // Y register
-
-    switch((chip8->inst.opcode.full_op & 0xF000) >> 12){ //Masks opcode so we only get 0xA000 where A is our Opcode
-        case 0x0:{
-            switch(chip8->inst.NN){
-                case 0xE0:{memset(&chip8->display[0], false, sizeof(chip8->display)); chip8->draw = true; break;} //Clear display
-                case 0xEE:{chip8->pc = *--chip8->stkptr; break;} //Pop off current subroutine and set pc to that subroutine
+    switch(inst->op){
+        case(OP_NOP):{break;}
+        case(OP_00E0):{memset(chip8->display, 0, sizeof(chip8->display)); chip8->draw = true; break;} //Clear display
+        case(OP_00EE):{chip8->pc = chip8->stack[--chip8->sp]; break;} //Pop off current subroutine and set pc to that subroutine
+        case(OP_1NNN):{chip8->pc = inst->NNN; break;} // Jump to address NNN
+        case(OP_2NNN):{chip8->stack[chip8->sp++] = chip8->pc; chip8->pc = inst->NNN; break;}
+        case(OP_3XNN):{if(chip8->V[inst->X] == inst->NN){chip8->pc += 2;} break;} //If VX is equal to NN increment PC
+        case(OP_4XNN):{if(chip8->V[inst->X] != inst->NN){chip8->pc += 2;} break;} //If VX is not equal to NN increment PC
+        case(OP_5XY0):{if(chip8->V[inst->X] == chip8->V[inst->Y]){chip8->pc += 2;} break;} // If VX == VY increment PC
+        case(OP_6XNN):{chip8->V[inst->X] = inst->NN; break;} //Set VX = NN
+        case(OP_7XNN):{chip8->V[inst->X] += inst->NN; break;} // Increment VX by the value NN
+        case(OP_8XY0):{chip8->V[inst->X] = chip8->V[inst->Y]; break;}
+        case(OP_8XY1):{chip8->V[inst->X] = chip8->V[inst->X] | chip8->V[inst->Y]; break;}
+        case(OP_8XY2):{chip8->V[inst->X] = chip8->V[inst->X] & chip8->V[inst->Y]; break;}
+        case(OP_8XY3):{chip8->V[inst->X] = chip8->V[inst->X] ^ chip8->V[inst->Y]; break;}
+        case(OP_8XY4):{
+            uint16_t result = chip8->V[inst->X] + chip8->V[inst->Y];
+            chip8->V[0xF] = (result > 0xFF) ? 1 : 0;
+            chip8->V[inst->X] = static_cast<uint8_t>(result);
+            break;
+        }
+        case(OP_8XY5):{
+            chip8->V[inst->X] -= chip8->V[inst->Y];
+            chip8->V[0xF] = (chip8->V[inst->X] >= chip8->V[inst->Y]) ? 1 : 0;
+            break; 
+        }
+        case(OP_8XY6):{
+            if(Quirks::shift_vy){
+                chip8->V[0xF] = (chip8->V[inst->Y] & 0x1);
+                chip8->V[inst->X] = chip8->V[inst->Y] >> 1;
+            }
+            else{
+                chip8->V[0xF] = (chip8->V[inst->X] & 0x1);
+                chip8->V[inst->X] >>= 1;
             }
             break;
         }
-        case(0x1):{chip8->pc = chip8->inst.NNN; break;} // Jump to address NNN
-        case(0x2):{*chip8->stkptr++ = chip8->pc; chip8->pc = chip8->inst.NNN; break;}
-        case(0x3):{if(chip8->V[chip8->inst.X] == chip8->inst.NN){chip8->pc += 2;} break;} //If VX is equal to NN increment PC
-        case(0x4):{if(chip8->V[chip8->inst.X] != chip8->inst.NN){chip8->pc += 2;} break;} //If VX is not equal to NN increment PC
-        case(0x5):{if(chip8->V[chip8->inst.X] == chip8->V[chip8->inst.Y]){chip8->pc += 2;} break;} // If VX == VY increment PC
-        case(0x6):{chip8->V[chip8->inst.X] = chip8->inst.NN; break;} //Set VX = NN
-        case(0x7):{chip8->V[chip8->inst.X] += chip8->inst.NN; break;} // Increment VX by the value NN
-        case(0x8):{
-            switch((chip8->inst.opcode.full_op & 0x000F)){
-                case(0x0):{chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y]; break;}
-                case(0x1):{chip8->V[chip8->inst.X] = chip8->V[chip8->inst.X] | chip8->V[chip8->inst.Y]; break;}
-                case(0x2):{chip8->V[chip8->inst.X] = chip8->V[chip8->inst.X] & chip8->V[chip8->inst.Y]; break;}
-                case(0x3):{chip8->V[chip8->inst.X] = chip8->V[chip8->inst.X] ^ chip8->V[chip8->inst.Y]; break;}
-                case(0x4):{
-                    uint16_t result = chip8->V[chip8->inst.X] + chip8->V[chip8->inst.Y];
-                    chip8->V[0xF] = (result > 0xFF) ? 1 : 0;
-                    chip8->V[chip8->inst.X] = static_cast<uint8_t>(result);
-                    break;
-                }
-                case(0x5):{
-                    chip8->V[chip8->inst.X] -= chip8->V[chip8->inst.Y];
-                    chip8->V[0xF] = (chip8->V[chip8->inst.X] >= chip8->V[chip8->inst.Y]) ? 1 : 0;
-                    break; 
-                    }
-                case(0x6):{
-                    switch(config->emu_choice){
-                        case(COSMAC):{
-                                chip8->V[0xF] = (chip8->V[chip8->inst.Y] & 0x1);
-                                chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] >> 1;
-                                break;
-                        }
-                        case(AMIGA):{
-                                chip8->V[0xF] = (chip8->V[chip8->inst.X] & 0x1);
-                                chip8->V[chip8->inst.X] >>= 1;
-                                break;
-                        }
-                    }
-                    break;
-                }
-                case(0x7):{
-                    chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] - chip8->V[chip8->inst.X];
-                    chip8->V[0xF] = (chip8->V[chip8->inst.Y] >= chip8->V[chip8->inst.X]) ? 1 : 0;
-                    break;
-                }
-                case(0xE):{
-                    switch(config->emu_choice){
-                            case(COSMAC):{
-                                chip8->V[0xF] = (chip8->V[chip8->inst.Y] & 0x80) >> 7;
-                                chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] << 1;
-                                break;
-                        }
-                        case(AMIGA):{
-                                chip8->V[0xF] = (chip8->V[chip8->inst.X] & 0x80) >> 7;
-                                chip8->V[chip8->inst.X] <<= 1;
-                                break;
-                        }
-
-                    }
-                    break;
-                }
-
+        case(OP_8XY7):{
+            chip8->V[inst->X] = chip8->V[inst->Y] - chip8->V[inst->X];
+            chip8->V[0xF] = (chip8->V[inst->Y] >= chip8->V[inst->X]) ? 1 : 0;
+            break;
+        }
+        case(OP_8XYE):{
+            if(Quirks::shift_vy){
+                chip8->V[0xF] = (chip8->V[inst->Y] & 0x80) >> 7;
+                chip8->V[inst->X] = chip8->V[inst->Y] << 1;
+            }
+            else{
+                chip8->V[0xF] = (chip8->V[inst->X] & 0x80) >> 7;
+                chip8->V[inst->X] <<= 1;
             }
+            break;
         }
-        break;
-        case(0x9):{if(chip8->V[chip8->inst.X] != chip8->V[chip8->inst.Y]){chip8->pc += 2; }break;}
-        case(0xA):{chip8->I = chip8->inst.NNN; break;}
-        case(0xB):{
-            switch(config->emu_choice){
-                case(COSMAC):{
-                    chip8->pc = chip8->inst.NNN + chip8->V[0];
-                    break;
-                }
-                case(AMIGA):{
-                    chip8->pc = chip8->inst.NNN + chip8->V[chip8->inst.X];
-                    break;
-                }
-            }   
+        case(OP_9XY0):{if(chip8->V[inst->X] != chip8->V[inst->Y]){chip8->pc += 2; }break;}
+        case(OP_ANNN):{chip8->I = inst->NNN; break;}
+        case(OP_BNNN):{
+            if(Quirks::jump_vx){chip8->pc = inst->NNN + chip8->V[inst->X];}
+            else{chip8->pc = inst->NNN + chip8->V[0];}
             break;
         }
-        case(0xC):{srand(time(NULL)); uint8_t random = rand(); chip8->V[chip8->inst.X] = random & chip8->inst.NN; break;}
-        case(0xD):{
+        case(OP_CXNN):{chip8->V[inst->X] = next_random(chip8) & inst->NN; break;}
+        case(OP_DXYN):{
 
             
-            uint8_t x_coord = chip8->V[chip8->inst.X] & 63;
-            uint8_t y_coord = chip8->V[chip8->inst.Y] & 31;
-            const uint8_t x_origin = x_coord; 
-
-            chip8->V[0xF] = 0;    
-
-            for (uint8_t i = 0; i < chip8->inst.N; i++) {
-                const uint8_t sprite_data = chip8->ram[chip8->I + i];
-                x_coord = x_origin; 
-
-                for (int8_t j = 0; j < 8; j++) {
-                    bool *display_pixel = &chip8->display[y_coord * 64 + x_coord]; 
-                    const bool sprite_bit = (sprite_data & (0x80 >> j));
-
-                    if (sprite_bit && *display_pixel) {
-                        chip8->V[0xF] = 1;  
-                    }
-
-                    *display_pixel ^= sprite_bit;
-
-                    x_coord++;
-                    if (x_coord >= 64){break;}
-                }
-
-                y_coord++;
-                if (y_coord >= 32){break;}
+            const uint8_t x_coord = chip8->V[inst->X] & 63;
+            const uint8_t y_coord = chip8->V[inst->Y] & 31;
+            uint64_t collision = 0;
+
+            //Whole sprite row at once, bits past the right edge shift out of the word
+            for (uint8_t i = 0; i < inst->N && y_coord + i < 32; i++) {
+                const uint64_t sprite_row = ((uint64_t)chip8->ram[chip8->I + i] << 56) >> x_coord;
+                collision |= chip8->display[y_coord + i] & sprite_row;
+                chip8->display[y_coord + i] ^= sprite_row;
             }
+
+            chip8->V[0xF] = collision ? 1 : 0;
             chip8->draw = true;
             break;
         }
-        case(0xE):{
-            switch(chip8->inst.NN){
-                case(0x9E):{if(chip8->keypad[chip8->V[chip8->inst.X]]){chip8->pc += 2;} break;}
-                case(0xA1):{if(!chip8->keypad[chip8->V[chip8->inst.X]]){chip8->pc += 2;} break;}
+        case(OP_EX9E):{if(chip8->keypad[chip8->V[inst->X]]){chip8->pc += 2;} break;}
+        case(OP_EXA1):{if(!chip8->keypad[chip8->V[inst->X]]){chip8->pc += 2;} break;}
+        case(OP_FX07):{chip8->V[inst->X] = chip8->delay_timer; break;}
+        case(OP_FX0A):{
+            uint8_t key_value = 0xFF;
+            bool key_pressed = false;
+            key_pressed = check_keypad(chip8, &key_value);
+
+            if(!key_pressed){chip8->pc -= 2; break;}
+            chip8->V[inst->X] = key_value;
+            break;
+        }
+        case(OP_FX15):{chip8->delay_timer = chip8->V[inst->X]; break;}
+        case(OP_FX18):{chip8->sound_timer = chip8->V[inst->X]; break;}
+        case(OP_FX1E):{
+            if(Quirks::index_carry){
+                uint32_t result = chip8->I + chip8->V[inst->X]; 
+                chip8->V[0xF] = (result > 0xFFF) ? 1 : 0;
+                chip8->I = static_cast<uint16_t>(result);
             }
+            else{chip8->I += chip8->V[inst->X];}
+            break;
         }
+        case(OP_FX29):{chip8->I = chip8->V[inst->X] * 5; break;}
+        case(OP_FX33):{
+            uint8_t va = chip8->V[inst->X];
+            chip8->ram[chip8->I+2] = va % 10;
+            va /= 10;
+            chip8->ram[chip8->I+1] = va % 10;
+            va /= 10;
+            chip8->ram[chip8->I] = va;
+            invalidate(chip8, chip8->I, 3); //Only FX33 and FX55 write to ram, so only they can make the cache stale
+            break;
+        }
+        case(OP_FX55):{
+            const uint16_t addr = chip8->I; //I may move, so remember where we wrote
+            const uint8_t X = inst->X; //inst may be one of the cache entries we are about to redecode
+            for(int i = 0; i <= X; i++){chip8->ram[chip8->I+i] = chip8->V[i];}
+            if(Quirks::load_store_i){chip8->I = X + 1;}
+            invalidate(chip8, addr, X + 1);
+            break;
+        }
+        case(OP_FX65):{
+            for(int i = 0; i <= inst->X; i++){chip8->V[i] = chip8->ram[chip8->I+i];}
+            if(Quirks::load_store_i){chip8->I = inst->X + 1;}
             break;
-        case(0xF):{
-            switch(chip8->inst.NN){
-                case(0x07):{chip8->V[chip8->inst.X] = chip8->delay_timer; break;}
-                case(0x0A):{
-                    uint8_t key_value = 0xFF;
-                    bool key_pressed = false;
-                    key_pressed = check_keypad(chip8, &key_value);
-
-                    if(!key_pressed){chip8->pc -= 2; break;}
-                    chip8->V[chip8->inst.X] = key_value;
-                    break;
-                }
-                case(0x15):{chip8->delay_timer = chip8->V[chip8->inst.X]; break;}
-                case(0x18):{chip8->sound_timer = chip8->V[chip8->inst.X]; break;}
-                case(0x1E):{
-                    switch(config->emu_choice){
-                        case 0:{chip8->I += chip8->V[chip8->inst.X]; break;}
-                        case 1:{
-                            uint32_t result = chip8->I + chip8->V[chip8->inst.X]; 
-                            chip8->V[0xF] = (result > 0xFFF) ? 1 : 0;
-                            chip8->I = (uint16_t)result;
-                            break;
-                        }
-                    }
-                    break;
-                }
-                case(0x29):{chip8->I = chip8->V[chip8->inst.X] * 5; break;}
-                case(0x33):{
-                    uint8_t va = chip8->V[chip8->inst.X];
-                    chip8->ram[chip8->I+2] = va % 10;
-                    va /= 10;
-                    chip8->ram[chip8->I+1] = va % 10;
-                    va /= 10;
-                    chip8->ram[chip8->I] = va;
-                    break;
-                }
-            case(0x55):{
-                switch(config->emu_choice){
-                    case(COSMAC):{for(int i = 0; i <= chip8->inst.X; i++){chip8->ram[chip8->I+i] = chip8->V[i];} chip8->I = chip8->inst.X + 1; break;}
-                    case(AMIGA):{for(int i = 0; i <= chip8->inst.X; i++){chip8->ram[chip8->I+i] = chip8->V[i];} break;}
-                }
-                break;
-            }
-            case(0x65):{
-                switch(config->emu_choice){
-                    case(COSMAC):{for(int i = 0; i <= chip8->inst.X; i++){chip8->V[i] = chip8->ram[chip8->I+i];} chip8->I = chip8->inst.X + 1; break;}
-                    case(AMIGA):{for(int i = 0; i <= chip8->inst.X; i++){chip8->V[i] = chip8->ram[chip8->I+i];} break;}
-                }
-                break;
-            }
-            
-            }
         }
+    }
+}
+typedef void (*emulate_type)(chip8_type *chip8);
 
+//Pick the emulate() specialisation for the current profile, only needs doing when the settings change
+emulate_type select_emulate(const config_type *config){
+    switch(config->emu_choice){
+        case(AMIGA):{return emulate<AmigaQuirks>;}
+        case(SCHIP):{return emulate<SchipQuirks>;}
+        default:{return emulate<CosmacQuirks>;}
     }
 }
+
 void sound_timer_play(config_type* config){
     speaker.period(1.0f/config->freq);
     speaker.write(config->volume);
@@ -454,10 +624,10 @@ void update_timers(chip8_type *chip8, config_type* config){
 
 void draw(chip8_type *chip8, const config_type *config){
     lcd.clear();
-    for (uint32_t i = 0; i < sizeof chip8->display; i++) {
+    for (uint32_t i = 0; i < 64 * 32; i++) {
         const unsigned int x0 = 10 + (i % config->res_x) * config->sf_x;
         const unsigned int y0 = 8 + (i / config->res_x) * config->sf_y;
-        if (chip8->display[i]) {
+        if ((chip8->display[i / 64] >> (63 - i % 64)) & 1) {
             lcd.drawRect(x0, y0, config->sf_x, config->sf_y, config->fg_colour);
         } 
         else {
@@ -539,6 +709,26 @@ void menu_input(int* current_bank, menu_type state, config_type* config){
                 break;
             }
             case(PAUSE):{
+                switch(dir){
+                    default:{break;}
+                    case(N):{
+                        switch(*current_bank){
+                            case(1):{(*current_bank) = 5; break;}
+                            default:{(*current_bank)--; break;}
+                        }
+                        break;
+                    }
+                    case(S):{
+                        switch(*current_bank){
+                            case(5):{(*current_bank) = 1; break;}
+                            default:{(*current_bank)++; break;}
+                        }
+                        break;
+                    }
+                }
+                break;
+            }
+            case(SETTINGS):{
                 switch(dir){
                     default:{break;}
                     case(N):{
@@ -558,6 +748,26 @@ void menu_input(int* current_bank, menu_type state, config_type* config){
                 }
                 break;
             }
+            case(STATES):{
+                switch(dir){
+                    default:{break;}
+                    case(N):{
+                        switch(*current_bank){
+                            case(2):{(*current_bank) = 4; break;}
+                            default:{(*current_bank)--; break;}
+                        }
+                        break;
+                    }
+                    case(S):{
+                        switch(*current_bank){
+                            case(4):{(*current_bank) = 2; break;}
+                            default:{(*current_bank)++; break;}
+                        }
+                        break;
+                    }
+                }
+                break;
+            }
             case(SCREEN):{
                 switch(dir){
                     default:{break;}
@@ -686,7 +896,8 @@ void menu_input(int* current_bank, menu_type state, config_type* config){
                             case(2):{
                                 switch(config->emu_choice){
                                     case(COSMAC):{config->emu_choice = AMIGA; break;}
-                                    case(AMIGA):{config->emu_choice = COSMAC; break;}
+                                    case(AMIGA):{config->emu_choice = SCHIP; break;}
+                                    case(SCHIP):{config->emu_choice = COSMAC; break;}
                                 }
                                 break;
                             }
@@ -705,8 +916,9 @@ void menu_input(int* current_bank, menu_type state, config_type* config){
                             default:{break;}
                             case(2):{
                                 switch(config->emu_choice){
-                                    case(COSMAC):{config->emu_choice = AMIGA; break;}
+                                    case(COSMAC):{config->emu_choice = SCHIP; break;}
                                     case(AMIGA):{config->emu_choice = COSMAC; break;}
+                                    case(SCHIP):{config->emu_choice = AMIGA; break;}
                                 }
                                 break;
                             }
@@ -788,12 +1000,20 @@ void menu_input(int* current_bank, menu_type state, config_type* config){
 void pause_menu(){
 
     lcd.printString("PAUSED", 24, 0);
-    lcd.printString("Settings", 18, 2);
+    lcd.printString("Settings", 18, 1);
+    lcd.printString("States", 24, 2);
     lcd.printString("Main Menu", 15, 3);
     lcd.printString("Reset", 27, 4);
     lcd.printString("Power OFF", 15, 5);
 }
 
+void states_menu(){
+    lcd.printString("STATES", 24, 0);
+    lcd.printString("Save", 30, 2);
+    lcd.printString(has_state ? "Load" : "Load (empty)", has_state ? 30 : 6, 3);
+    lcd.printString("BACK", 30, 4);
+}
+
 void main_menu(){
     lcd.printString("RAHUL'S CHIP-8", 0, 0);
     lcd.printString("START", 27, 2);
@@ -992,6 +1212,7 @@ void emu_menu(config_type* config){
     switch(config->emu_choice){
         case(COSMAC):{lcd.printString("COSMAC", 48, 2); break;}
         case(AMIGA):{lcd.printString("AMIGA", 48, 2); break;}
+        case(SCHIP):{lcd.printString("SCHIP", 48, 2); break;}
     }
 
     sprintf(str_buffer, "%d", config->clk_speed);
@@ -1122,6 +1343,7 @@ void return_main(chip8_type* chip8, config_type* config){
     chip8->sound_timer = 0;
     memset(chip8->keypad, false, sizeof(chip8->keypad));
     chip8->draw = false;
+    chip8->sp = 0;
 
     config->rom_choice = BLITZ;
     chip8->state = QUIT;
@@ -1130,15 +1352,50 @@ void return_main(chip8_type* chip8, config_type* config){
 
 
 
+void states_screen(config_type* config, chip8_type* chip8){
+    lcd.clear();
+    lcd.printChar('>', 6, 2);
+    states_menu();
+    lcd.refresh();
+
+    int current_bank = 2;
+    bool states_select = false;
+
+    while(!states_select){
+        power_off(chip8, &states_select, &current_bank);
+        menu_input(&current_bank, STATES, config);
+        inputs pressed_input = keypad.get_key_pressed();
+        switch(pressed_input){
+            default:{break;}
+            case(One):{states_select = true; break;}
+            case(Two):{states_select = true; current_bank = 10; break;}
+        }
+        lcd.clear();
+        states_menu();
+        lcd.printChar('>', 6, current_bank);
+        lcd.refresh();
+
+        ThisThread::sleep_for(150ms);
+    }
+
+    switch(current_bank){
+        case(2):{save_state(chip8, config, &saved_state); has_state = true; pause_screen(config, chip8); break;}
+        case(3):{if(has_state){load_state(chip8, config, &saved_state);} pause_screen(config, chip8); break;}
+        case(4):{pause_screen(config, chip8); break;}
+        case(10):{pause_screen(config, chip8); break;}
+        default:{break;}
+    }
+}
+
 void pause_screen(config_type* config, chip8_type* chip8){
     lcd.clear();
-    lcd.printChar('>', 9, 2);
+    lcd.printChar('>', 9, 1);
     pause_menu();
     lcd.refresh();
 
 
 
-    int current_bank = 2;
+    int current_bank = 1;
     bool pause_select = false;
 
     while(g_joystick_flag == 0){
@@ -1161,7 +1418,8 @@ void pause_screen(config_type* config, chip8_type* chip8){
     switch(pause_select){
             case(true):{
                 switch (current_bank){
-                case(2):{settings_screen(PAUSE, config, chip8); break;}
+                case(1):{settings_screen(PAUSE, config, chip8); break;}
+                case(2):{states_screen(config, chip8); break;}
                 case(3):{return_main(chip8, config); break;}
                 case(4):{reset(chip8); break;}
                 default:{break;}
@@ -1199,7 +1457,7 @@ void settings_screen(menu_type menu, config_type* config, chip8_type* chip8){
             case(One):{settings_select = true; break;}
             case(Two):{settings_select = true; current_bank = 10; break;}
         }
-        menu_input(&current_bank, PAUSE, config);
+        menu_input(&current_bank, SETTINGS, config);
         lcd.clear();
         settings_menu();
         lcd.printChar('>', 9, current_bank);
@@ -1362,8 +1620,6 @@ int main(){
     init_config(config); 
 
     chip8_type *chip8 = static_cast<chip8_type *>(malloc(sizeof(chip8_type)));
-    chip8->stkptr = static_cast<uint16_t *>(malloc(sizeof(uint16_t)));
-    chip8->stkptr = nullptr;
     init_chip8(chip8, config);
 
     joystick_button.fall(&isr_joy);
@@ -1410,10 +1666,12 @@ int main(){
             case(RUNNING):{
                 game_input(chip8);
 
+                const emulate_type emulate_fn = select_emulate(config);
+
                 t.start();
 
                 for(int i = 0; i < config->insts_per_sec / config->clk_speed; i++){
-                    emulate(chip8,config);
+                    emulate_fn(chip8);
                 }
 
                 t.stop();
@@ -1452,7 +1710,6 @@ int main(){
     }
 
     free(config);
-    free(chip8->stkptr);
     free(chip8);
 
     